@@ -0,0 +1,320 @@
+#ifndef BLOK_ALLOCATOR_C
+#define BLOK_ALLOCATOR_C
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Backing allocator for arenas, modeled on the Allocator vtable from pimbs.
+ * A zero initialized blok_Allocator means malloc, realloc and free*/
+struct blok_Allocator;
+
+typedef void * (*blok_AllocFn)(struct blok_Allocator, size_t);
+typedef void * (*blok_ReallocFn)(struct blok_Allocator, void *, size_t);
+typedef void   (*blok_FreeFn)(struct blok_Allocator, void *);
+
+typedef struct blok_Allocator {
+    void * ctx;
+    blok_AllocFn alloc;
+    blok_ReallocFn realloc;
+    blok_FreeFn free;
+} blok_Allocator;
+
+void * blok_allocator_alloc(blok_Allocator a, size_t bytes) {
+    return a.alloc == NULL ? malloc(bytes) : a.alloc(a, bytes);
+}
+
+void * blok_allocator_realloc(blok_Allocator a, void * ptr, size_t bytes) {
+    return a.realloc == NULL ? realloc(ptr, bytes) : a.realloc(a, ptr, bytes);
+}
+
+void blok_allocator_free(blok_Allocator a, void * ptr) {
+    if(a.free == NULL) free(ptr); else a.free(a, ptr);
+}
+
+
+/*LIBC*/
+
+void * blok_libc_alloc(blok_Allocator self, size_t bytes) {
+    (void)self;
+    return malloc(bytes);
+}
+
+void * blok_libc_realloc(blok_Allocator self, void * ptr, size_t bytes) {
+    (void)self;
+    return realloc(ptr, bytes);
+}
+
+void blok_libc_free(blok_Allocator self, void * ptr) {
+    (void)self;
+    free(ptr);
+}
+
+blok_Allocator blok_libc_allocator(void) {
+    return (blok_Allocator){NULL, blok_libc_alloc, blok_libc_realloc, blok_libc_free};
+}
+
+
+/*LOGGING*/
+
+typedef struct {
+    blok_Allocator child;
+    FILE * fp;
+} blok_LoggingCtx;
+
+void * blok_logging_alloc(blok_Allocator self, size_t bytes) {
+    blok_LoggingCtx * ctx = self.ctx;
+    void * mem = blok_allocator_alloc(ctx->child, bytes);
+    fprintf(ctx->fp, "Allocating %p with %zu bytes via ctx %p%s\n", mem, bytes, self.ctx, mem == NULL ? " failed" : "");
+    return mem;
+}
+
+void * blok_logging_realloc(blok_Allocator self, void * ptr, size_t bytes) {
+    blok_LoggingCtx * ctx = self.ctx;
+    void * mem = blok_allocator_realloc(ctx->child, ptr, bytes);
+    fprintf(ctx->fp, "Reallocating %p to %p to store %zu bytes via ctx %p%s\n", ptr, mem, bytes, self.ctx, mem == NULL ? " failed" : "");
+    return mem;
+}
+
+void blok_logging_free(blok_Allocator self, void * ptr) {
+    blok_LoggingCtx * ctx = self.ctx;
+    fprintf(ctx->fp, "Freeing %p via ctx %p\n", ptr, self.ctx);
+    blok_allocator_free(ctx->child, ptr);
+}
+
+blok_Allocator blok_logging_allocator(blok_LoggingCtx * ctx) {
+    return (blok_Allocator){ctx, blok_logging_alloc, blok_logging_realloc, blok_logging_free};
+}
+
+
+/*LEAKCHECK*/
+
+/* Live allocations are kept in an open addressing hash table keyed by pointer,
+ * so realloc and free stay O(1) no matter how many allocations are live*/
+typedef struct {
+    void * ptr;
+    size_t bytes;
+} blok_AllocRecord;
+
+#define BLOK_LEAK_CHECK_TOMBSTONE ((void*)1)
+
+typedef struct {
+    blok_Allocator child;
+    blok_AllocRecord * records;
+    size_t cap; /*always a power of two*/
+    size_t len;
+    size_t used; /*len plus tombstones*/
+} blok_LeakCheck;
+
+size_t blok_leak_check_hash(void * ptr) {
+    uint64_t x = (uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+blok_AllocRecord * blok_leak_check_find(blok_LeakCheck * lc, void * ptr) {
+    if(lc->cap == 0) return NULL;
+    for(size_t i = blok_leak_check_hash(ptr) & (lc->cap - 1);; i = (i + 1) & (lc->cap - 1)) {
+        if(lc->records[i].ptr == ptr) return &lc->records[i];
+        if(lc->records[i].ptr == NULL) return NULL;
+    }
+}
+
+void blok_leak_check_insert(blok_LeakCheck * lc, void * ptr, size_t bytes);
+
+void blok_leak_check_grow(blok_LeakCheck * lc) {
+    blok_AllocRecord * old = lc->records;
+    const size_t old_cap = lc->cap;
+    lc->cap = lc->cap == 0 ? 64 : (lc->len * 4 > lc->cap ? lc->cap * 2 : lc->cap);
+    lc->records = blok_allocator_alloc(lc->child, lc->cap * sizeof(blok_AllocRecord));
+    assert(lc->records != NULL);
+    memset(lc->records, 0, lc->cap * sizeof(blok_AllocRecord));
+    lc->len = lc->used = 0;
+    for(size_t i = 0; i < old_cap; ++i) {
+        if(old[i].ptr != NULL && old[i].ptr != BLOK_LEAK_CHECK_TOMBSTONE) {
+            blok_leak_check_insert(lc, old[i].ptr, old[i].bytes);
+        }
+    }
+    if(old != NULL) blok_allocator_free(lc->child, old);
+}
+
+void blok_leak_check_insert(blok_LeakCheck * lc, void * ptr, size_t bytes) {
+    if((lc->used + 1) * 10 > lc->cap * 7) {
+        blok_leak_check_grow(lc);
+    }
+    size_t i = blok_leak_check_hash(ptr) & (lc->cap - 1);
+    while(lc->records[i].ptr != NULL && lc->records[i].ptr != BLOK_LEAK_CHECK_TOMBSTONE) {
+        i = (i + 1) & (lc->cap - 1);
+    }
+    if(lc->records[i].ptr == NULL) ++lc->used;
+    lc->records[i] = (blok_AllocRecord){ptr, bytes};
+    ++lc->len;
+}
+
+void * blok_leak_check_alloc(blok_Allocator self, size_t bytes) {
+    blok_LeakCheck * lc = self.ctx;
+    void * mem = blok_allocator_alloc(lc->child, bytes);
+    if(mem != NULL) blok_leak_check_insert(lc, mem, bytes);
+    return mem;
+}
+
+void * blok_leak_check_realloc(blok_Allocator self, void * ptr, size_t bytes) {
+    blok_LeakCheck * lc = self.ctx;
+    if(ptr == NULL) return blok_leak_check_alloc(self, bytes);
+    blok_AllocRecord * old = blok_leak_check_find(lc, ptr);
+    assert(old != NULL && "realloc of a pointer that was not allocated");
+    void * mem = blok_allocator_realloc(lc->child, ptr, bytes);
+    if(mem == NULL) return NULL;
+    old->ptr = BLOK_LEAK_CHECK_TOMBSTONE;
+    --lc->len;
+    blok_leak_check_insert(lc, mem, bytes);
+    return mem;
+}
+
+void blok_leak_check_free(blok_Allocator self, void * ptr) {
+    blok_LeakCheck * lc = self.ctx;
+    if(ptr == NULL) return;
+    blok_AllocRecord * record = blok_leak_check_find(lc, ptr);
+    assert(record != NULL && "free of a pointer that was not allocated");
+    record->ptr = BLOK_LEAK_CHECK_TOMBSTONE;
+    --lc->len;
+    blok_allocator_free(lc->child, ptr);
+}
+
+blok_Allocator blok_leak_check_allocator(blok_LeakCheck * lc) {
+    return (blok_Allocator){lc, blok_leak_check_alloc, blok_leak_check_realloc, blok_leak_check_free};
+}
+
+size_t blok_leak_check_count_leaks(const blok_LeakCheck * lc) {
+    return lc->len;
+}
+
+void blok_leak_check_fprint_leaks(const blok_LeakCheck * lc, FILE * fp) {
+    for(size_t i = 0; i < lc->cap; ++i) {
+        const blok_AllocRecord record = lc->records[i];
+        if(record.ptr != NULL && record.ptr != BLOK_LEAK_CHECK_TOMBSTONE) {
+            fprintf(fp, "leaked address %p containing %zu bytes\n", record.ptr, record.bytes);
+        }
+    }
+}
+
+void blok_leak_check_deinit(blok_LeakCheck * lc) {
+    if(lc->records != NULL) blok_allocator_free(lc->child, lc->records);
+    *lc = (blok_LeakCheck){.child = lc->child};
+}
+
+
+/*FIXED BUFFER*/
+
+/* Bump allocates out of a caller provided buffer and never calls into the os.
+ * Every allocation is preceded by its size, only the top allocation can be
+ * freed or grown in place*/
+typedef struct {
+    char * buf;
+    size_t len;
+    size_t i;
+} blok_FixedBuffer;
+
+#define BLOK_FIXED_BUFFER_ALIGNMENT 16
+
+blok_FixedBuffer blok_fixed_buffer_init(char * buf, size_t len) {
+    const size_t padding = (BLOK_FIXED_BUFFER_ALIGNMENT - ((uintptr_t)buf % BLOK_FIXED_BUFFER_ALIGNMENT)) % BLOK_FIXED_BUFFER_ALIGNMENT;
+    assert(len > padding);
+    return (blok_FixedBuffer){.buf = buf + padding, .len = len - padding, .i = 0};
+}
+
+size_t blok_fixed_buffer_size_of(void * mem) {
+    return *((size_t *)mem - 1);
+}
+
+bool blok_fixed_buffer_is_top(const blok_FixedBuffer * fb, void * mem) {
+    return (char*)mem + blok_fixed_buffer_size_of(mem) == fb->buf + fb->i;
+}
+
+void * blok_fixed_buffer_alloc(blok_Allocator self, size_t bytes) {
+    blok_FixedBuffer * fb = self.ctx;
+    const size_t header = BLOK_FIXED_BUFFER_ALIGNMENT;
+    const size_t size = (bytes + BLOK_FIXED_BUFFER_ALIGNMENT - 1) & ~(size_t)(BLOK_FIXED_BUFFER_ALIGNMENT - 1);
+    if(fb->len - fb->i < header + size) return NULL;
+    char * mem = fb->buf + fb->i + header;
+    *((size_t *)mem - 1) = size;
+    fb->i += header + size;
+    return mem;
+}
+
+void blok_fixed_buffer_free(blok_Allocator self, void * mem) {
+    blok_FixedBuffer * fb = self.ctx;
+    if(mem != NULL && blok_fixed_buffer_is_top(fb, mem)) {
+        fb->i -= BLOK_FIXED_BUFFER_ALIGNMENT + blok_fixed_buffer_size_of(mem);
+    }
+}
+
+void * blok_fixed_buffer_realloc(blok_Allocator self, void * mem, size_t bytes) {
+    blok_FixedBuffer * fb = self.ctx;
+    if(mem == NULL) return blok_fixed_buffer_alloc(self, bytes);
+    const size_t old_size = blok_fixed_buffer_size_of(mem);
+    const size_t size = (bytes + BLOK_FIXED_BUFFER_ALIGNMENT - 1) & ~(size_t)(BLOK_FIXED_BUFFER_ALIGNMENT - 1);
+    if(blok_fixed_buffer_is_top(fb, mem) && fb->len - fb->i + old_size >= size) {
+        fb->i = fb->i - old_size + size;
+        *((size_t *)mem - 1) = size;
+        return mem;
+    }
+    char * new_mem = blok_fixed_buffer_alloc(self, bytes);
+    if(new_mem == NULL) return NULL;
+    memcpy(new_mem, mem, old_size < bytes ? old_size : bytes);
+    return new_mem;
+}
+
+blok_Allocator blok_fixed_buffer_allocator(blok_FixedBuffer * fb) {
+    return (blok_Allocator){fb, blok_fixed_buffer_alloc, blok_fixed_buffer_realloc, blok_fixed_buffer_free};
+}
+
+void blok_allocator_run_tests(void) {
+    {
+        blok_LeakCheck lc = {.child = blok_libc_allocator()};
+        blok_Allocator a = blok_leak_check_allocator(&lc);
+        void * ptrs[1000];
+        for(int i = 0; i < 1000; ++i) {
+            ptrs[i] = blok_allocator_alloc(a, 16 + i);
+        }
+        for(int i = 0; i < 1000; i += 2) {
+            ptrs[i] = blok_allocator_realloc(a, ptrs[i], 4000);
+        }
+        assert(blok_leak_check_count_leaks(&lc) == 1000);
+        for(int i = 0; i < 999; ++i) {
+            blok_allocator_free(a, ptrs[i]);
+        }
+        assert(blok_leak_check_count_leaks(&lc) == 1);
+        blok_allocator_free(a, ptrs[999]);
+        assert(blok_leak_check_count_leaks(&lc) == 0);
+        blok_leak_check_deinit(&lc);
+    }
+    {
+        static char buf[4096];
+        blok_FixedBuffer fb = blok_fixed_buffer_init(buf, sizeof(buf));
+        blok_Allocator a = blok_fixed_buffer_allocator(&fb);
+        char * first = blok_allocator_alloc(a, 10);
+        assert(((uintptr_t)first % BLOK_FIXED_BUFFER_ALIGNMENT) == 0);
+        memset(first, 3, 10);
+        char * grown = blok_allocator_realloc(a, first, 100);
+        assert(grown == first);
+        char * second = blok_allocator_alloc(a, 100);
+        char * moved = blok_allocator_realloc(a, grown, 200);
+        assert(moved != grown && moved[9] == 3);
+        char * too_big = blok_allocator_alloc(a, sizeof(buf));
+        assert(too_big == NULL);
+        blok_allocator_free(a, moved);
+        char * reused = blok_allocator_alloc(a, 200);
+        assert(reused == moved);
+        (void)second;
+        (void)too_big;
+        (void)reused;
+    }
+}
+
+#endif /*BLOK_ALLOCATOR_C*/
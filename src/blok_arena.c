@@ -5,7 +5,10 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define LOG(...) do { fflush(stdout); fprintf(stderr, __VA_ARGS__); fflush(stderr); } while (0)
 #define UNREACHABLE do { LOG("Unreachable code block reached! Aborting..."); exit(1); } while (0);
@@ -13,130 +16,530 @@
 #define STATIC_ASSERT(cond, name) const char static_assert_##name[ cond ? 1 : -1 ]
 
 #include "blok_profiler.c"
+#include "blok_allocator.c"
 
+/* every allocation handed out by the arena is aligned to this, blok_obj_from_ptr relies on it */
+#define BLOK_ARENA_ALIGNMENT 16
+#define BLOK_ARENA_CHUNK_SIZE (64 * 1024)
+
+#define blok_arena_align(bytes) (((bytes) + (BLOK_ARENA_ALIGNMENT - 1)) & ~(size_t)(BLOK_ARENA_ALIGNMENT - 1))
+
+/*virtual arenas commit memory in steps of this size and keep this much committed across a reset*/
+#define BLOK_ARENA_COMMIT_SIZE (1024 * 1024)
+#define BLOK_ARENA_RETAIN_SIZE (4 * BLOK_ARENA_COMMIT_SIZE)
+
+#if defined(MAP_ANONYMOUS) && defined(MAP_NORESERVE) && defined(MADV_DONTNEED)
+#   define BLOK_ARENA_VIRTUAL_SUPPORTED 1
+#else
+#   define BLOK_ARENA_VIRTUAL_SUPPORTED 0
+#endif
+
+typedef struct blok_ArenaChunk {
+    struct blok_ArenaChunk * next;
+    size_t cap;
+    size_t used;
+    size_t committed; /*bytes that are currently backed by memory, equal to cap unless mapped*/
+    bool mapped;      /*reserved with mmap rather than allocated with malloc*/
+} blok_ArenaChunk;
+
+/*stored in front of every allocation so realloc and reclaim don't have to search for it*/
 typedef struct {
     size_t cap;
+    uint32_t waste; /*cap minus the requested bytes, saturated, only used for statistics*/
     bool active;
-    char * ptr;
-} blok_Allocation;
+} blok_AllocationHeader;
+STATIC_ASSERT(sizeof(blok_AllocationHeader) % BLOK_ARENA_ALIGNMENT == 0, allocation_header_keeps_alignment);
+
+/*reclaimed blocks are threaded through their own memory*/
+typedef struct blok_FreeBlock {
+    struct blok_FreeBlock * next;
+} blok_FreeBlock;
+
+/*bin i holds free blocks with a capacity in [2^i, 2^(i+1))*/
+#define BLOK_ARENA_BIN_COUNT 64
+/*free blocks with at least this much to spare get split, the tail goes back into a bin*/
+#define BLOK_ARENA_MIN_SPLIT 64
+
+/* Same sized objects are carved out of pages of slots without a header of
+ * their own, reclaimed slots are threaded through an intrusive free list*/
+#define BLOK_ARENA_SLAB_COUNT 8
+#define BLOK_ARENA_SLAB_PAGE_SIZE 4096
 
 typedef struct {
-    blok_Allocation * allocations;
-    size_t len;
-    size_t cap;
+    size_t slot_size;
+    blok_FreeBlock * free;
+    char * next_slot;
+    char * page_end;
+} blok_Slab;
+
+/*the position of a mark, offsets are only ever compared within the same chunk*/
+typedef struct {
+    blok_ArenaChunk * chunk; /*NULL when there is no fence*/
+    size_t used;
+} blok_ArenaFence;
+
+typedef struct {
+    size_t active_bytes; /*capacity of live allocations*/
+    size_t wasted_bytes; /*capacity of live allocations beyond what was requested*/
+    size_t free_bytes;   /*capacity sitting in the bins*/
+    size_t reused_count; /*allocations served from a bin instead of the bump pointer*/
+    size_t split_count;
+} blok_ArenaStats;
+
+typedef struct {
+    /*where unmapped chunks come from, zero initialized means malloc and free*/
+    blok_Allocator allocator;
+
+    /*chunks are never released before blok_arena_free, reset just rewinds to the first one*/
+    blok_ArenaChunk * first;
+    blok_ArenaChunk * current;
+
+    blok_FreeBlock * bins[BLOK_ARENA_BIN_COUNT];
+    uint64_t nonempty_bins;
+    blok_ArenaStats stats;
+
+    blok_Slab slabs[BLOK_ARENA_SLAB_COUNT];
+
+    /*allocations below the most recent mark may not grow or be popped in place*/
+    blok_ArenaFence fence;
 } blok_Arena;
 
+/*everything allocated after a mark is released by rewinding to it*/
+typedef struct {
+    blok_ArenaChunk * chunk;
+    size_t used;
+    blok_ArenaFence fence;
+    blok_ArenaStats stats;
+} blok_ArenaMark;
+
+char * blok_arena_chunk_begin(blok_ArenaChunk * chunk) {
+    return (char*)chunk + blok_arena_align(sizeof(blok_ArenaChunk));
+}
+
 void blok_arena_fprint_contents(const blok_Arena * a, FILE * fp) {
     fprintf(fp, "(\n");
-    for(size_t i = 0; i < a->len; ++i) {
-        const blok_Allocation item = a->allocations[i];
-        fprintf(fp, "    (active:%s cap:%zu)\n", item.active ? "true" : "false", item.cap);
+    for(blok_ArenaChunk * chunk = a->first; chunk != NULL; chunk = chunk->next) {
+        fprintf(fp, "    (chunk cap:%zu used:%zu committed:%zu%s%s)\n",
+                chunk->cap, chunk->used, chunk->committed,
+                chunk->mapped ? " mapped" : "",
+                chunk == a->current ? " current" : "");
     }
     fprintf(fp, ")\n");
 }
 
-blok_Allocation blok_arena_allocation_new(size_t bytes) {
-    /*allocate new*/
-    blok_profiler_start("arena_allocation_new");
-    blok_Allocation new = (blok_Allocation){
-        .active = false,
-        .cap = bytes,
-        .ptr = malloc(bytes),
-    };
-    assert(new.ptr != NULL);
-    blok_profiler_stop("arena_allocation_new");
-    return new;
+void blok_arena_fprint_stats(const blok_Arena * a, FILE * fp) {
+    const blok_ArenaStats st = a->stats;
+    fprintf(fp, "(active_bytes:%zu wasted_bytes:%zu free_bytes:%zu reused:%zu split:%zu)\n",
+            st.active_bytes, st.wasted_bytes, st.free_bytes, st.reused_count, st.split_count);
 }
 
-void blok_arena_append_allocation(blok_Arena * a, blok_Allocation new) {
-    blok_profiler_start("arena_append_allocation");
-    if(a->cap == 0) {
-        assert(a->len == 0);
-        assert(a->allocations == NULL);
-        a->cap = 4;
-        a->allocations = malloc(sizeof(blok_Allocation) * a->cap);
-    } else if(a->len + 1 >= a->cap) {
-        a->cap = a->cap * 2 + 1;
-        a->allocations = realloc(a->allocations, sizeof(blok_Allocation) * a->cap);
+int blok_arena_floor_log2(size_t n) {
+    assert(n > 0);
+    return 63 - __builtin_clzll(n);
+}
+
+int blok_arena_ceil_log2(size_t n) {
+    return n <= 1 ? 0 : 64 - __builtin_clzll(n - 1);
+}
+
+blok_ArenaChunk * blok_arena_chunk_new(blok_Allocator allocator, size_t bytes) {
+    blok_profiler_start("arena_chunk_new");
+    const size_t cap = bytes > BLOK_ARENA_CHUNK_SIZE ? blok_arena_align(bytes) : BLOK_ARENA_CHUNK_SIZE;
+    blok_ArenaChunk * chunk = blok_allocator_alloc(allocator, blok_arena_align(sizeof(blok_ArenaChunk)) + cap);
+    assert(chunk != NULL);
+    assert(((uintptr_t)chunk & (BLOK_ARENA_ALIGNMENT - 1)) == 0);
+    chunk->next = NULL;
+    chunk->cap = cap;
+    chunk->used = 0;
+    chunk->committed = cap;
+    chunk->mapped = false;
+    blok_profiler_stop("arena_chunk_new");
+    return chunk;
+}
+
+/* Reserves `reserve` bytes of address space, memory is only committed as the
+ * chunk fills up. Returns NULL when reserving is not possible*/
+blok_ArenaChunk * blok_arena_chunk_map(size_t reserve, bool huge_pages) {
+#if BLOK_ARENA_VIRTUAL_SUPPORTED
+    reserve = (reserve + BLOK_ARENA_COMMIT_SIZE - 1) & ~(size_t)(BLOK_ARENA_COMMIT_SIZE - 1);
+    assert(BLOK_ARENA_COMMIT_SIZE % sysconf(_SC_PAGESIZE) == 0);
+    void * mem = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mem == MAP_FAILED) return NULL;
+    if(mprotect(mem, BLOK_ARENA_COMMIT_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        munmap(mem, reserve);
+        return NULL;
     }
-    a->allocations[a->len++] = new;
-    blok_profiler_stop("arena_append_allocation");
+#   ifdef MADV_HUGEPAGE
+    if(huge_pages) madvise(mem, reserve, MADV_HUGEPAGE);
+#   else
+    (void)huge_pages;
+#   endif
+    blok_ArenaChunk * chunk = mem;
+    const size_t header = blok_arena_align(sizeof(blok_ArenaChunk));
+    chunk->next = NULL;
+    chunk->cap = reserve - header;
+    chunk->used = 0;
+    chunk->committed = BLOK_ARENA_COMMIT_SIZE - header;
+    chunk->mapped = true;
+    return chunk;
+#else
+    (void)reserve;
+    (void)huge_pages;
+    return NULL;
+#endif
 }
 
+/*commits memory until the first `bytes` of the chunk are usable*/
+bool blok_arena_chunk_commit(blok_ArenaChunk * chunk, size_t bytes) {
+    if(bytes <= chunk->committed) return true;
+    if(bytes > chunk->cap) return false;
+#if BLOK_ARENA_VIRTUAL_SUPPORTED
+    assert(chunk->mapped);
+    const size_t header = blok_arena_align(sizeof(blok_ArenaChunk));
+    size_t end = (header + bytes + BLOK_ARENA_COMMIT_SIZE - 1) & ~(size_t)(BLOK_ARENA_COMMIT_SIZE - 1);
+    if(end > header + chunk->cap) end = header + chunk->cap;
+    char * begin = (char*)chunk + header + chunk->committed;
+    if(mprotect(begin, (char*)chunk + end - begin, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    chunk->committed = end - header;
+    return true;
+#else
+    UNREACHABLE;
+#endif
+}
 
+/*gives the memory beyond the first `keep` bytes of a mapped chunk back to the os*/
+void blok_arena_chunk_decommit(blok_ArenaChunk * chunk, size_t keep) {
+#if BLOK_ARENA_VIRTUAL_SUPPORTED
+    if(!chunk->mapped) return;
+    const size_t header = blok_arena_align(sizeof(blok_ArenaChunk));
+    const size_t end = (header + keep + BLOK_ARENA_COMMIT_SIZE - 1) & ~(size_t)(BLOK_ARENA_COMMIT_SIZE - 1);
+    if(end >= header + chunk->committed) return;
+    char * begin = (char*)chunk + end;
+    const size_t len = header + chunk->committed - end;
+    madvise(begin, len, MADV_DONTNEED);
+    mprotect(begin, len, PROT_NONE);
+    chunk->committed = end - header;
+#else
+    (void)chunk;
+    (void)keep;
+#endif
+}
+
+void blok_arena_chunk_free(blok_Allocator allocator, blok_ArenaChunk * chunk) {
+    if(chunk->mapped) {
+        munmap(chunk, blok_arena_align(sizeof(blok_ArenaChunk)) + chunk->cap);
+    } else {
+        blok_allocator_free(allocator, chunk);
+    }
+}
+
+/*true if `bytes` more bytes can be bumped off of the chunk*/
+bool blok_arena_chunk_fits(blok_ArenaChunk * chunk, size_t bytes) {
+    return chunk->cap - chunk->used >= bytes && blok_arena_chunk_commit(chunk, chunk->used + bytes);
+}
+
+/* Backs the arena with a single mapping of `reserve` bytes of address space
+ * instead of malloc'd chunks. Reset gives most of the memory back to the os and
+ * blok_arena_free is a single munmap. Falls back to malloc'd chunks when the
+ * reservation fails, or once it is full*/
+void blok_arena_init_virtual(blok_Arena * a, size_t reserve, bool huge_pages) {
+    assert(a->first == NULL && "arena is already initialized");
+    blok_ArenaChunk * chunk = blok_arena_chunk_map(reserve, huge_pages);
+    if(chunk != NULL) {
+        a->first = a->current = chunk;
+    }
+}
+
+/*makes a chunk with at least `bytes` free space the current chunk*/
+void blok_arena_next_chunk(blok_Arena * a, size_t bytes) {
+    if(a->current == NULL) {
+        assert(a->first == NULL);
+        a->first = a->current = blok_arena_chunk_new(a->allocator, bytes);
+        return;
+    }
+
+    /*chunks after current were filled before the last reset, reuse them*/
+    while(a->current->next != NULL) {
+        a->current = a->current->next;
+        a->current->used = 0;
+        if(blok_arena_chunk_fits(a->current, bytes)) return;
+    }
+
+    blok_ArenaChunk * chunk = blok_arena_chunk_new(a->allocator, bytes);
+    a->current->next = chunk;
+    a->current = chunk;
+}
+
+blok_AllocationHeader * blok_arena_get_header(void * ptr) {
+    return (blok_AllocationHeader *)ptr - 1;
+}
+
+/*only the allocation at the top of the current chunk can be grown, shrunk or popped in place*/
+bool blok_arena_is_top(const blok_Arena * a, void * ptr) {
+    blok_ArenaChunk * chunk = a->current;
+    if(chunk == NULL) return false;
+    char * begin = blok_arena_chunk_begin(chunk);
+    if((char*)ptr + blok_arena_get_header(ptr)->cap != begin + chunk->used) return false;
+    /*ptr is in the current chunk now, a fence in an older chunk is below it*/
+    return a->fence.chunk != chunk || (size_t)((char*)ptr - begin) >= a->fence.used;
+}
+
+void blok_arena_set_requested(blok_Arena * a, blok_AllocationHeader * header, size_t bytes) {
+    const size_t waste = header->cap > bytes ? header->cap - bytes : 0;
+    a->stats.wasted_bytes -= header->waste;
+    header->waste = waste > UINT32_MAX ? UINT32_MAX : (uint32_t)waste;
+    a->stats.wasted_bytes += header->waste;
+}
+
+void blok_arena_bin_push(blok_Arena * a, blok_AllocationHeader * header) {
+    const int bin = blok_arena_floor_log2(header->cap);
+    blok_FreeBlock * block = (blok_FreeBlock *)(header + 1);
+    block->next = a->bins[bin];
+    a->bins[bin] = block;
+    a->nonempty_bins |= (uint64_t)1 << bin;
+    a->stats.free_bytes += header->cap;
+}
+
+/*pops a block from the smallest non-empty bin whose blocks all fit `cap`, returns NULL if there is none*/
+blok_AllocationHeader * blok_arena_bin_pop(blok_Arena * a, size_t cap) {
+    const int min_bin = blok_arena_ceil_log2(cap);
+    if(min_bin >= BLOK_ARENA_BIN_COUNT) return NULL;
+    const uint64_t candidates = a->nonempty_bins & (~(uint64_t)0 << min_bin);
+    if(candidates == 0) return NULL;
+
+    const int bin = __builtin_ctzll(candidates);
+    blok_FreeBlock * block = a->bins[bin];
+    a->bins[bin] = block->next;
+    if(a->bins[bin] == NULL) {
+        a->nonempty_bins &= ~((uint64_t)1 << bin);
+    }
+    blok_AllocationHeader * header = blok_arena_get_header(block);
+    a->stats.free_bytes -= header->cap;
+    assert(header->cap >= cap);
+
+    if(header->cap - cap >= sizeof(blok_AllocationHeader) + BLOK_ARENA_MIN_SPLIT) {
+        blok_AllocationHeader * tail = (blok_AllocationHeader *)((char*)(header + 1) + cap);
+        tail->cap = header->cap - cap - sizeof(blok_AllocationHeader);
+        tail->waste = 0;
+        tail->active = false;
+        header->cap = cap;
+        blok_arena_bin_push(a, tail);
+        ++a->stats.split_count;
+    }
+    ++a->stats.reused_count;
+    return header;
+}
+
+/*ensures the next `num_allocations` allocations of `bytes_per_allocation` can be served without calling malloc*/
 void blok_arena_reserve(blok_Arena * a, size_t num_allocations, size_t bytes_per_allocation) {
     blok_profiler_start("blok_arena_reserve");
-    for(size_t i = 0; i < num_allocations; ++i) {
-        blok_arena_append_allocation(a, blok_arena_allocation_new(bytes_per_allocation));
+    const size_t bytes = num_allocations * (sizeof(blok_AllocationHeader) + blok_arena_align(bytes_per_allocation));
+    if(a->current == NULL || !blok_arena_chunk_fits(a->current, bytes)) {
+        blok_arena_next_chunk(a, bytes);
     }
     blok_profiler_stop("blok_arena_reserve");
 }
 
-
 void * blok_arena_alloc(blok_Arena * a, size_t bytes) {
     blok_profiler_start("blok_arena_alloc");
-    /*search for available allocation*/
-    for(size_t i = 0; i < a->len; ++i) {
-        blok_Allocation * allocation = &a->allocations[i];
-        if(allocation->active == false && allocation->cap >= bytes) {
-            allocation->active = true; 
-            blok_profiler_stop("blok_arena_alloc");
-            return allocation->ptr;
+    const size_t cap = blok_arena_align(bytes == 0 ? 1 : bytes);
+    blok_AllocationHeader * header = blok_arena_bin_pop(a, cap);
+    if(header == NULL) {
+        const size_t size = sizeof(blok_AllocationHeader) + cap;
+        if(a->current == NULL || !blok_arena_chunk_fits(a->current, size)) {
+            blok_arena_next_chunk(a, size);
         }
+        header = (blok_AllocationHeader *)(blok_arena_chunk_begin(a->current) + a->current->used);
+        a->current->used += size;
+        header->cap = cap;
     }
-
-    blok_Allocation new = blok_arena_allocation_new(bytes);
-    new.active = true;
-    blok_arena_append_allocation(a, new);
+    header->active = true;
+    header->waste = 0;
+    a->stats.active_bytes += header->cap;
+    blok_arena_set_requested(a, header, bytes);
+    char * ptr = (char*)(header + 1);
 
     blok_profiler_stop("blok_arena_alloc");
-    return new.ptr;
+    return ptr;
 }
 
-void * blok_arena_memdup(blok_Arena * a, void * ptr, size_t bytes) {
+void * blok_arena_memdup(blok_Arena * a, const void * ptr, size_t bytes) {
     char * mem = blok_arena_alloc(a, bytes);
     memcpy(mem, ptr, bytes);
     return mem;
 }
 
+void blok_arena_reclaim(blok_Arena * a, void * ptr);
+
 void * blok_arena_realloc(blok_Arena * a, void * ptr, size_t bytes) {
-    for(size_t i = 0; i < a->len; ++i) {
-        blok_Allocation * allocation = &a->allocations[i];
-        if(allocation->ptr == ptr) {
-            allocation->ptr = realloc(allocation->ptr, bytes);
-            allocation->cap = bytes;
-            return allocation->ptr;
+    blok_AllocationHeader * header = blok_arena_get_header(ptr);
+    assert(header->active && "Tried to realloc an inactive ptr");
+    const size_t cap = blok_arena_align(bytes > 0 ? bytes : 1);
+    if(header->cap >= bytes) {
+        /*shrinking the top allocation gives the tail back to the chunk*/
+        if(header->cap > cap && blok_arena_is_top(a, ptr)) {
+            a->current->used -= header->cap - cap;
+            a->stats.active_bytes -= header->cap - cap;
+            header->cap = cap;
         }
+        blok_arena_set_requested(a, header, bytes);
+        return ptr;
     }
-    assert(0 && "Tried to realloc unknown ptr");
-    return NULL;
+
+    if(blok_arena_is_top(a, ptr) && blok_arena_chunk_fits(a->current, cap - header->cap)) {
+        a->current->used += cap - header->cap;
+        a->stats.active_bytes += cap - header->cap;
+        header->cap = cap;
+        blok_arena_set_requested(a, header, bytes);
+        return ptr;
+    }
+
+    char * mem = blok_arena_alloc(a, bytes);
+    memcpy(mem, ptr, header->cap);
+    blok_arena_reclaim(a, ptr);
+    return mem;
 }
 
 void blok_arena_reclaim(blok_Arena * a, void * ptr) {
-    for(size_t i = 0; i < a->len; ++i) {
-        blok_Allocation * allocation = &a->allocations[i];
-        if(allocation->ptr == ptr) {
-            allocation->active = false;
-            return;
-        }
+    blok_AllocationHeader * header = blok_arena_get_header(ptr);
+    assert(header->active && "Tried to reclaim an inactive ptr");
+    header->active = false;
+    a->stats.active_bytes -= header->cap;
+    a->stats.wasted_bytes -= header->waste;
+    header->waste = 0;
+
+    /*the most recent allocation can simply be popped off of the current chunk*/
+    if(blok_arena_is_top(a, ptr)) {
+        a->current->used -= sizeof(blok_AllocationHeader) + header->cap;
+    } else {
+        blok_arena_bin_push(a, header);
+    }
+}
+
+/*allocates from slab `id`, every allocation from the same slab must have the same size*/
+void * blok_arena_slab_alloc(blok_Arena * a, int id, size_t bytes) {
+    assert(id >= 0 && id < BLOK_ARENA_SLAB_COUNT);
+    blok_Slab * slab = &a->slabs[id];
+    const size_t slot_size = blok_arena_align(bytes < sizeof(blok_FreeBlock) ? sizeof(blok_FreeBlock) : bytes);
+    assert((slab->slot_size == 0 || slab->slot_size == slot_size) && "slab used for different sizes");
+    slab->slot_size = slot_size;
+
+    if(slab->free != NULL) {
+        blok_FreeBlock * slot = slab->free;
+        slab->free = slot->next;
+        return slot;
+    }
+    if(slab->next_slot == NULL || slab->next_slot + slot_size > slab->page_end) {
+        const size_t page_size = slot_size > BLOK_ARENA_SLAB_PAGE_SIZE ? slot_size : BLOK_ARENA_SLAB_PAGE_SIZE - BLOK_ARENA_SLAB_PAGE_SIZE % slot_size;
+        slab->next_slot = blok_arena_alloc(a, page_size);
+        slab->page_end = slab->next_slot + page_size;
+    }
+    void * slot = slab->next_slot;
+    slab->next_slot += slot_size;
+    return slot;
+}
+
+void blok_arena_slab_reclaim(blok_Arena * a, int id, void * ptr) {
+    assert(id >= 0 && id < BLOK_ARENA_SLAB_COUNT);
+    blok_FreeBlock * slot = ptr;
+    slot->next = a->slabs[id].free;
+    a->slabs[id].free = slot;
+}
+
+/*forgets all free blocks and slab pages, used when the memory behind them is released*/
+void blok_arena_clear_bins(blok_Arena * a) {
+    memset(a->bins, 0, sizeof(a->bins));
+    a->nonempty_bins = 0;
+    a->stats.free_bytes = 0;
+    for(int i = 0; i < BLOK_ARENA_SLAB_COUNT; ++i) {
+        a->slabs[i].free = NULL;
+        a->slabs[i].next_slot = a->slabs[i].page_end = NULL;
     }
-    assert(0 && "Tried to reclaim unknown ptr");
 }
 
 void blok_arena_reset(blok_Arena * a) {
-    for(size_t i = 0; i < a->len; ++i) {
-        a->allocations[i].active = false;
+    a->current = a->first;
+    if(a->current != NULL) {
+        a->current->used = 0;
+        blok_arena_chunk_decommit(a->current, BLOK_ARENA_RETAIN_SIZE);
     }
+    a->fence = (blok_ArenaFence){0};
+    blok_arena_clear_bins(a);
+    a->stats.active_bytes = 0;
+    a->stats.wasted_bytes = 0;
+}
+
+/*true when `ptr` points into memory the arena has handed out since its last reset*/
+bool blok_arena_owns(const blok_Arena * a, const void * ptr) {
+    const char * p = ptr;
+    for(blok_ArenaChunk * chunk = a->first; chunk != NULL; chunk = chunk->next) {
+        const char * begin = blok_arena_chunk_begin(chunk);
+        if(p >= begin && p < begin + chunk->used) return true;
+        if(chunk == a->current) break;
+    }
+    return false;
+}
+
+/* Identifies the arena in O(1) for as long as the allocations it tags are
+ * alive. The first chunk is kept until blok_arena_free and moves with copies
+ * of the arena struct, NULL until the first allocation*/
+const void * blok_arena_id(const blok_Arena * a) {
+    return a->first;
+}
+
+blok_ArenaMark blok_arena_mark(blok_Arena * a) {
+    blok_ArenaMark mark = {
+        .chunk = a->current,
+        .used = a->current == NULL ? 0 : a->current->used,
+        .fence = a->fence,
+        .stats = a->stats,
+    };
+    if(a->current != NULL) {
+        a->fence = (blok_ArenaFence){a->current, a->current->used};
+    }
+    return mark;
+}
+
+/* Marks must be rewound in reverse order. The bins are emptied since they may
+ * hold blocks from after the mark, blocks reclaimed before it are only
+ * recovered by the next reset*/
+void blok_arena_rewind(blok_Arena * a, blok_ArenaMark mark) {
+    if(mark.chunk == NULL) {
+        blok_arena_reset(a);
+        return;
+    }
+    a->current = mark.chunk;
+    a->current->used = mark.used;
+    a->fence = mark.fence;
+    blok_arena_clear_bins(a);
+    a->stats.active_bytes = mark.stats.active_bytes;
+    a->stats.wasted_bytes = mark.stats.wasted_bytes;
+}
+
+/*releases the memory the arena is not currently using, marks taken since the last rewind stay valid*/
+void blok_arena_trim(blok_Arena * a) {
+    if(a->current == NULL) return;
+    blok_ArenaChunk * chunk = a->current->next;
+    a->current->next = NULL;
+    while(chunk != NULL) {
+        blok_ArenaChunk * next = chunk->next;
+        blok_arena_chunk_free(a->allocator, chunk);
+        chunk = next;
+    }
+    blok_arena_chunk_decommit(a->current, a->current->used);
 }
 
 void blok_arena_free(blok_Arena * a) {
     blok_profiler_do("arena_free") {
-        for(size_t i = 0; i < a->len; ++i) {
-            free(a->allocations[i].ptr);
+        blok_ArenaChunk * chunk = a->first;
+        while(chunk != NULL) {
+            blok_ArenaChunk * next = chunk->next;
+            blok_arena_chunk_free(a->allocator, chunk);
+            chunk = next;
         }
-        free(a->allocations);
-        a->cap = 0;
-        a->len = 0;
+        *a = (blok_Arena){.allocator = a->allocator};
     }
 }
 
@@ -148,15 +551,26 @@ void blok_arena_run_tests(void) {
         memset(mem, 0, 16);
         char * mem2 = blok_arena_alloc(&a, 1000);
         memset(mem2, 0, 1000);
-        blok_arena_reclaim(&a, mem);
+        blok_arena_reclaim(&a, mem2);
         char * mem3 = blok_arena_alloc(&a, 8);
-        assert(mem3 == mem);
+        assert(mem3 == mem2);
         char * mem4 = blok_arena_realloc(&a, mem3, 1000);
         memset(mem4, 1, 1000);
+        assert(mem4 == mem3 && "the top allocation grows in place");
         char * mem5 = blok_arena_alloc(&a, 500);
-        blok_arena_reclaim(&a, mem4);
-        mem5 = blok_arena_realloc(&a, mem5, 1000);
-        memset(mem5, 2, 1000);
+        memset(mem5, 2, 500);
+        char * mem6 = blok_arena_realloc(&a, mem4, 2000);
+        assert(mem6 != mem4);
+        for(int i = 0; i < 1000; ++i) {
+            assert(mem6[i] == 1);
+        }
+        blok_arena_reclaim(&a, mem6);
+        char * mem7 = blok_arena_realloc(&a, mem5, 1000);
+        assert(mem7 == mem5);
+        memset(mem7, 2, 1000);
+        for(int i = 0; i < 16; ++i) {
+            assert(mem[i] == 0);
+        }
     }
     blok_arena_reset(&a);
     blok_arena_reserve(&a, 10, 1000);
@@ -172,7 +586,154 @@ void blok_arena_run_tests(void) {
             assert(mem2[i] == 9);
         }
     }
+    blok_arena_reset(&a);
+    {
+        /*odd sizes and allocations larger than a chunk keep their alignment*/
+        char * first = blok_arena_alloc(&a, 3);
+        assert(first == blok_arena_chunk_begin(a.first) + sizeof(blok_AllocationHeader));
+        (void)first;
+        for(size_t i = 1; i < 200; ++i) {
+            char * mem = blok_arena_alloc(&a, i * 37);
+            assert(((uintptr_t)mem & (BLOK_ARENA_ALIGNMENT - 1)) == 0);
+            memset(mem, (int)i, i * 37);
+        }
+        char * big = blok_arena_alloc(&a, BLOK_ARENA_CHUNK_SIZE * 3);
+        assert(((uintptr_t)big & (BLOK_ARENA_ALIGNMENT - 1)) == 0);
+        memset(big, 3, BLOK_ARENA_CHUNK_SIZE * 3);
+    }
+    blok_arena_reset(&a);
+    {
+        char * start = blok_arena_alloc(&a, 1);
+        assert(start == blok_arena_chunk_begin(a.first) + sizeof(blok_AllocationHeader));
+        (void)start;
+    }
+    blok_arena_reset(&a);
+    {
+        /*reclaimed blocks are reused from their bin, a small request only takes what it needs*/
+        char * big = blok_arena_alloc(&a, 1000);
+        char * guard = blok_arena_alloc(&a, 16);
+        assert(a.stats.wasted_bytes == 8);
+        blok_arena_reclaim(&a, big);
+        assert(a.stats.free_bytes == 1008);
+        char * small = blok_arena_alloc(&a, 16);
+        assert(small == big);
+        assert(a.stats.reused_count == 1 && a.stats.split_count == 1);
+        char * medium = blok_arena_alloc(&a, 500);
+        assert(medium == small + 16 + sizeof(blok_AllocationHeader));
+        memset(medium, 4, 500);
+        assert(a.stats.wasted_bytes == 12);
+        blok_arena_reclaim(&a, small);
+        blok_arena_reclaim(&a, medium);
+        blok_arena_reclaim(&a, guard);
+        assert(a.stats.active_bytes == 0 && a.stats.wasted_bytes == 0);
+    }
+    blok_arena_reset(&a);
+    {
+        char * before = blok_arena_alloc(&a, 32);
+        memset(before, 5, 32);
+        blok_ArenaMark outer = blok_arena_mark(&a);
+        char * first = blok_arena_alloc(&a, 100);
+        /*allocations from before the mark are not grown in place*/
+        char * moved = blok_arena_realloc(&a, before, 64);
+        assert(moved != before && moved[31] == 5);
+
+        blok_ArenaMark inner = blok_arena_mark(&a);
+        for(int i = 0; i < 100; ++i) {
+            blok_arena_alloc(&a, BLOK_ARENA_CHUNK_SIZE / 8);
+        }
+        blok_arena_rewind(&a, inner);
+        char * after_inner = blok_arena_alloc(&a, 100);
+        assert(after_inner == moved + 64 + sizeof(blok_AllocationHeader));
+
+        blok_arena_rewind(&a, outer);
+        char * after_outer = blok_arena_alloc(&a, 100);
+        assert(after_outer == first);
+        assert(a.stats.active_bytes == 32 + 112);
+        (void)first;
+        (void)moved;
+        (void)after_inner;
+        (void)after_outer;
+    }
+    blok_arena_reset(&a);
+    {
+        /*slab slots are packed without headers and reclaimed slots are reused*/
+        char * s1 = blok_arena_slab_alloc(&a, 0, 24);
+        char * s2 = blok_arena_slab_alloc(&a, 0, 24);
+        assert(s2 == s1 + 32);
+        for(int i = 0; i < 1000; ++i) {
+            char * slot = blok_arena_slab_alloc(&a, 0, 24);
+            assert(((uintptr_t)slot & (BLOK_ARENA_ALIGNMENT - 1)) == 0);
+            memset(slot, 1, 24);
+        }
+        blok_arena_slab_reclaim(&a, 0, s1);
+        char * reused = blok_arena_slab_alloc(&a, 0, 24);
+        assert(reused == s1);
+        char * other = blok_arena_slab_alloc(&a, 1, 200);
+        char * next = blok_arena_slab_alloc(&a, 1, 200);
+        assert(next == other + 208);
+        (void)s2;
+        (void)reused;
+        (void)other;
+        (void)next;
+
+        blok_Arena other_arena = {0};
+        int stack_int = 0;
+        assert(blok_arena_owns(&a, s1));
+        assert(!blok_arena_owns(&other_arena, s1));
+        assert(!blok_arena_owns(&a, &stack_int));
+        (void)stack_int;
+        (void)other_arena;
+    }
+    blok_arena_reset(&a);
+    blok_arena_trim(&a);
+    assert(a.first->next == NULL);
+    blok_arena_free(&a);
+
+    blok_arena_init_virtual(&a, (size_t)1 << 32, false);
+    {
+        /*a mapped arena commits on demand and grows the top allocation in place far past a chunk*/
+        char * grow = blok_arena_alloc(&a, 100);
+        memset(grow, 6, 100);
+        for(size_t bytes = 200; bytes < 8 * BLOK_ARENA_COMMIT_SIZE; bytes *= 2) {
+            char * grown = blok_arena_realloc(&a, grow, bytes);
+            assert(grown == grow || !a.first->mapped);
+            grow = grown;
+            memset(grow + bytes / 2, 6, bytes / 2);
+        }
+        assert(grow[0] == 6);
+        const size_t committed = a.first->committed;
+        blok_arena_reset(&a);
+        assert(a.first->committed <= committed);
+        assert(a.first->committed < BLOK_ARENA_RETAIN_SIZE + BLOK_ARENA_COMMIT_SIZE || !a.first->mapped);
+        char * again = blok_arena_alloc(&a, BLOK_ARENA_COMMIT_SIZE * 6);
+        memset(again, 1, BLOK_ARENA_COMMIT_SIZE * 6);
+        blok_arena_reclaim(&a, again);
+        blok_arena_trim(&a);
+        (void)committed;
+    }
     blok_arena_free(&a);
+
+    {
+        /*chunks come from the arena's allocator and all of them are handed back by blok_arena_free*/
+        blok_LeakCheck lc = {.child = blok_libc_allocator()};
+        blok_Arena checked = {.allocator = blok_leak_check_allocator(&lc)};
+        for(int i = 0; i < 100; ++i) {
+            blok_arena_alloc(&checked, 1000 * i);
+        }
+        assert(blok_leak_check_count_leaks(&lc) > 1);
+        blok_arena_free(&checked);
+        assert(blok_leak_check_count_leaks(&lc) == 0);
+        blok_leak_check_deinit(&lc);
+
+        static char buf[4 * BLOK_ARENA_CHUNK_SIZE];
+        blok_FixedBuffer fb = blok_fixed_buffer_init(buf, sizeof(buf));
+        blok_Arena fixed = {.allocator = blok_fixed_buffer_allocator(&fb)};
+        char * mem = blok_arena_alloc(&fixed, 1000);
+        assert(mem > buf && mem < buf + sizeof(buf));
+        blok_arena_free(&fixed);
+        assert(fb.i == 0);
+        (void)mem;
+    }
     blok_profiler_stop("arena_run_tests");
 }
 
@@ -3,12 +3,12 @@
 
 #include "blok_arena.c"
 #include "blok_obj.c"
+#include "blok_reader.c"
 
 #include <ctype.h>
 
 void blok_type_fprint(blok_State * s, FILE * out, blok_Type type) {
-    blok_TypeData t = blok_type_get_data(s, type);
-    switch(t.tag) {
+    switch(blok_type_get_tag(s, type)) {
         case BLOK_TYPETAG_VOID:
             fprintf(out, "void");
             break;
@@ -68,31 +68,28 @@ void blok_state_bind_toplevel_primitive(blok_State * s, blok_Primitive prim) {
 
 
 void blok_state_create_global(blok_State * s, const char * symbol, blok_Obj obj) {
-    blok_Binding * it = NULL;
     const blok_Symbol name = blok_symbol_from_string(s, symbol);
-    blok_vec_find(it, &s->globals, it->name == name);
-    if(it != NULL) {
-        blok_fatal_error(&obj.src_info, "Multiply defined symbol");
+    if(blok_scopes_lookup_current(&s->globals, name) != NULL) {
+        blok_fatal_error(&s->locations, obj.location, "Multiply defined symbol");
     }
     blok_Binding binding = {
         .name = name,
         .type = blok_compiler_infer_typeof_value(s, obj),
         .value = obj,
     };
-    blok_vec_append(&s->globals, &s->persistent_arena, binding);
+    blok_scopes_define(&s->globals, &s->persistent_arena, binding);
 }
 
 void blok_state_create_global_primitive(blok_State * s, blok_Primitive prim) {
-    blok_Primitive * mem = blok_arena_alloc(&s->persistent_arena, sizeof(blok_Primitive));
+    blok_Primitive * mem = blok_primitive_allocate(&s->persistent_arena);
     *mem = prim;
     blok_state_create_global(s, blok_symbol_get_data(s, prim.name).buf, blok_obj_from_primitive(mem));
 }
 
 bool blok_compiler_lookup_symbol(const blok_State * s, blok_Symbol sym, blok_Binding * result) {
-    blok_Binding * it = NULL;
-    blok_vec_find(it, &s->locals, it->name == sym);
+    blok_Binding * it = blok_scopes_lookup(&s->locals, sym);
     if(it == NULL) {
-        blok_vec_find(it, &s->globals, it->name == sym);
+        it = blok_scopes_lookup(&s->globals, sym);
         if(it == NULL) {
             goto failure;
         } else {
@@ -113,9 +110,113 @@ success:
     return true;
 }
 
-blok_State blok_state_init(void) {
+/* Annotates every symbol inside `obj` with the binding it currently refers
+ * to, so later phases index into the scopes instead of looking names up.
+ * Symbols that are not bound yet are left unresolved. Shared lists and
+ * keyvalues are unshared into `a` before they are annotated*/
+void blok_compiler_resolve(const blok_State * s, blok_Arena * a, blok_Obj * obj) {
+    switch(obj->tag) {
+        case BLOK_TAG_SYMBOL: {
+            const blok_Symbol sym = obj->as.symbol.id;
+            const blok_Binding * local = blok_scopes_lookup(&s->locals, sym);
+            const blok_Binding * global = blok_scopes_lookup(&s->globals, sym);
+            if(local != NULL) {
+                obj->as.symbol.ref = blok_ref_make(BLOK_REF_LOCAL, local - s->locals.bindings.items.ptr);
+            } else if(global != NULL) {
+                obj->as.symbol.ref = blok_ref_make(BLOK_REF_GLOBAL, global - s->globals.bindings.items.ptr);
+            } else {
+                obj->as.symbol.ref = BLOK_REF_NONE;
+            }
+            break;
+        }
+        case BLOK_TAG_LIST: {
+            blok_List * l = blok_list_unshare(a, obj);
+            blok_vec_foreach(blok_Obj, it, l) {
+                blok_compiler_resolve(s, a, it);
+            }
+            break;
+        }
+        case BLOK_TAG_KEYVALUE:
+            blok_compiler_resolve(s, a, &blok_keyvalue_unshare(a, obj)->value);
+            break;
+        default:
+            break;
+    }
+}
+
+void blok_compiler_resolve_body(const blok_State * s, blok_Arena * a, blok_ListRef body) {
+    blok_profiler_do("compiler_resolve_body") {
+        blok_slice_foreach(blok_Obj, it, body) {
+            blok_compiler_resolve(s, a, it);
+        }
+    }
+}
+
+/* Drops the local references inside `obj`, they index into the scopes of the
+ * procedure being compiled and mean nothing once it is done*/
+void blok_compiler_forget_locals(blok_Arena * a, blok_Obj * obj) {
+    switch(obj->tag) {
+        case BLOK_TAG_SYMBOL:
+            if(blok_ref_kind(obj->as.symbol.ref) == BLOK_REF_LOCAL) {
+                obj->as.symbol.ref = BLOK_REF_NONE;
+            }
+            break;
+        case BLOK_TAG_LIST: {
+            blok_List * l = blok_list_unshare(a, obj);
+            blok_vec_foreach(blok_Obj, it, l) {
+                blok_compiler_forget_locals(a, it);
+            }
+            break;
+        }
+        case BLOK_TAG_KEYVALUE:
+            blok_compiler_forget_locals(a, &blok_keyvalue_unshare(a, obj)->value);
+            break;
+        default:
+            break;
+    }
+}
+
+/* like blok_compiler_lookup_symbol, but uses the reference stored by
+ * blok_compiler_resolve if it still points at a binding of the same name*/
+bool blok_compiler_lookup_obj(const blok_State * s, blok_Obj symbol_obj, blok_Binding * result) {
+    assert(symbol_obj.tag == BLOK_TAG_SYMBOL);
+    const blok_Symbol sym = symbol_obj.as.symbol.id;
+    const blok_Ref ref = symbol_obj.as.symbol.ref;
+    const blok_Scopes * sc = NULL;
+    switch(blok_ref_kind(ref)) {
+        case BLOK_REF_GLOBAL:
+            sc = &s->globals;
+            break;
+        case BLOK_REF_LOCAL:
+            sc = &s->locals;
+            break;
+        default:
+            break;
+    }
+    if(sc != NULL && blok_ref_index(ref) < sc->bindings.items.len) {
+        const blok_Binding * binding = &sc->bindings.items.ptr[blok_ref_index(ref)];
+        if(binding->name == sym) {
+            *result = *binding;
+            return true;
+        }
+    }
+    return blok_compiler_lookup_symbol(s, sym, result);
+}
+
+/* Every arena of the state gets its chunks from `allocator`. A zero initialized
+ * allocator uses virtual arenas backed by mmap instead*/
+blok_State blok_state_init_with_allocator(blok_Allocator allocator) {
     blok_State result = {0};
     blok_State * s = &result;
+    const bool virtual = allocator.alloc == NULL;
+    s->binding_epoch = 1; /*zeroed cache entries are never valid*/
+
+    s->persistent_arena.allocator = allocator;
+    if(virtual) blok_arena_init_virtual(&s->persistent_arena, BLOK_STATE_ARENA_RESERVE, BLOK_STATE_ARENA_HUGE_PAGES);
+    for(int i = 0; i < BLOK_ARENA_COUNT; ++i) {
+        blok_vec_append(&s->arenas, &s->persistent_arena, (blok_Arena){.allocator = allocator});
+        if(virtual) blok_arena_init_virtual(blok_state_arena(s, i), BLOK_STATE_ARENA_RESERVE, BLOK_STATE_ARENA_HUGE_PAGES);
+    }
 
     blok_state_create_global(s, "true", blok_make_true());
     blok_state_create_global(s, "false", blok_make_false());
@@ -128,7 +229,7 @@ blok_State blok_state_init(void) {
         .tag = BLOK_PRIMITIVE_TOPLEVEL_LET,
         .signature = blok_signature_intern(s, (blok_Signature){
             .param_count = 2,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_symbol(s), .noeval = true },
                 (blok_ParamType){.type = blok_type_obj(s)}
             },
@@ -142,7 +243,7 @@ blok_State blok_state_init(void) {
         .tag = BLOK_PRIMITIVE_WHEN,
         .signature = blok_signature_intern(s, (blok_Signature){
             .param_count = 1,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_bool(s)},
             },
             .return_type = blok_type_void(s),
@@ -168,7 +269,7 @@ blok_State blok_state_init(void) {
         .signature = blok_signature_intern(s, (blok_Signature){
             .return_type = blok_type_void(s),
             .param_count = 1,
-            .params = {(blok_ParamType){.type = blok_type_obj(s)}}
+            .params = (blok_ParamType[]){(blok_ParamType){.type = blok_type_obj(s)}}
         })
     });
 
@@ -179,7 +280,7 @@ blok_State blok_state_init(void) {
         .signature = blok_signature_intern(s, (blok_Signature){
             .return_type = blok_type_int(s),
             .param_count = 2,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_int(s)},
                 (blok_ParamType){.type = blok_type_int(s)}
             }
@@ -192,7 +293,7 @@ blok_State blok_state_init(void) {
         .signature = blok_signature_intern(s, (blok_Signature){
             .return_type = blok_type_int(s),
             .param_count = 2,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_int(s)},
                 (blok_ParamType){.type = blok_type_int(s)}
             }
@@ -206,7 +307,7 @@ blok_State blok_state_init(void) {
         .signature = blok_signature_intern(s, (blok_Signature){
             .return_type = blok_type_int(s),
             .param_count = 2,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_int(s)},
                 (blok_ParamType){.type = blok_type_int(s)}
             }
@@ -219,7 +320,7 @@ blok_State blok_state_init(void) {
         .signature = blok_signature_intern(s, (blok_Signature){
             .return_type = blok_type_void(s),
             .param_count = 1,
-            .params = {
+            .params = (blok_ParamType[]){
                 (blok_ParamType){.type = blok_type_int(s)}
             }
         })
@@ -231,7 +332,7 @@ blok_State blok_state_init(void) {
        .tag = BLOK_PRIMITIVE_TOPLEVEL_PROCEDURE,
        .signature = blok_signature_intern(s, (blok_Signature){
            .param_count = 3,
-           .params = {
+           .params = (blok_ParamType[]){
                (blok_ParamType){.type = blok_type_symbol(s), .noeval = true},
                (blok_ParamType){.type = blok_type_symbol(s), .noeval = true},
                (blok_ParamType){.type = blok_type_obj(s), .noeval = true},
@@ -245,8 +346,16 @@ blok_State blok_state_init(void) {
     return result;
 }
 
+blok_State blok_state_init(void) {
+    return blok_state_init_with_allocator((blok_Allocator){0});
+}
+
 void blok_state_deinit(blok_State * s) {
+    blok_vec_foreach(blok_Arena, it, &s->arenas) {
+        blok_arena_free(it);
+    }
     blok_arena_free(&s->persistent_arena);
+    blok_location_table_free(&s->locations);
 }
 
 bool blok_symbol_is_varname(blok_State * s, blok_Symbol symbol) {
@@ -272,7 +381,7 @@ blok_Type blok_expr_infer_type(blok_State * s, blok_Obj expr) {
         case BLOK_TAG_STRING:
             return blok_type_string(s);
         default:
-            blok_fatal_error(&expr.src_info, "TODO: implement type inference for this type of obj");
+            blok_fatal_error(&s->locations, expr.location, "TODO: implement type inference for this type of obj");
     }
 }
 
@@ -280,22 +389,22 @@ blok_Type blok_expr_infer_type(blok_State * s, blok_Obj expr) {
 //    (void)output;
 //    if(args.len != 2) {
 //        if(args.len <= 0) {
-//            blok_fatal_error(NULL, "Let forms required 2 arguments");
+//            blok_fatal_error(BLOK_LOCATION_NONE, "Let forms required 2 arguments");
 //        } else {
-//            blok_fatal_error(&args.ptr[0].src_info, "Let forms required 2 arguments");
+//            blok_fatal_error(args.ptr[0].location, "Let forms required 2 arguments");
 //        }
 //    }
 //    blok_Symbol name = blok_symbol_from_obj(args.ptr[0]);
 //    if(!blok_symbol_is_varname(s, name)) {
 //        blok_SymbolData namesym = blok_symbol_get_data(s, name);
-//        blok_fatal_error(&args.ptr[0].src_info, "Invalid variable name provided inside #let form: %s", namesym.buf);
+//        blok_fatal_error(args.ptr[0].location, "Invalid variable name provided inside #let form: %s", namesym.buf);
 //    }
 //    blok_Obj expr = args.ptr[1];
 //    blok_Type type = blok_expr_infer_type(s, expr);
 //    blok_Binding * it = NULL;
 //    blok_vec_find(it, globals, it->name == name);
 //    if(it != NULL) {
-//        blok_fatal_error(&args.ptr[0].src_info, "Multiply defined symbol");
+//        blok_fatal_error(args.ptr[0].location, "Multiply defined symbol");
 //    }
 //    blok_Binding binding = (blok_Binding){.name = name, .type = type, .value = args.ptr[1], .comptime_known = true};
 //    blok_vec_append(globals, &s->persistent_arena, binding);
@@ -304,12 +413,12 @@ blok_Type blok_expr_infer_type(blok_State * s, blok_Obj expr) {
 void blok_compiler_validate_sexpr(blok_State * s, blok_Obj sexpr) {
     (void)s;
     if(sexpr.tag != BLOK_TAG_LIST)
-        blok_fatal_error(&sexpr.src_info, "Expected s-expression, found %s", blok_tag_get_name(sexpr.tag));
+        blok_fatal_error(&s->locations, sexpr.location, "Expected s-expression, found %s", blok_tag_get_name(sexpr.tag));
     blok_List * l = blok_list_from_obj(sexpr);
     if(l->items.len < 1) 
-        blok_fatal_error(&sexpr.src_info, "Found empty s-expression");
+        blok_fatal_error(&s->locations, sexpr.location, "Found empty s-expression");
     if(l->items.ptr[0].tag != BLOK_TAG_SYMBOL)
-        blok_fatal_error(&sexpr.src_info, "Expected symbol inside s-expression, found %s", blok_tag_get_name(l->items.ptr[0].tag));
+        blok_fatal_error(&s->locations, sexpr.location, "Expected symbol inside s-expression, found %s", blok_tag_get_name(l->items.ptr[0].tag));
 }
 
 //void blok_compiler_primitive_procedure(blok_State * s, blok_Bindings * globals, blok_ListRef args, FILE * output) {
@@ -364,40 +473,36 @@ blok_Type blok_compiler_infer_typeof_value(blok_State * s, blok_Obj value) {
             //TODO("figure out a better way to store the types of primitives");
             return blok_function_from_obj(value)->signature;
         default:
-            blok_fatal_error(NULL, "TODO: implement type inference for these types: %s", blok_tag_get_name(value.tag));
+            blok_fatal_error(&s->locations, BLOK_LOCATION_NONE, "TODO: implement type inference for these types: %s", blok_tag_get_name(value.tag));
     }
 }
 
-blok_Type blok_compiler_infer_typeof_expr_list(blok_State * s, blok_SourceInfo * src, blok_Obj sexpr) {
+blok_Type blok_compiler_infer_typeof_expr_list(blok_State * s, blok_Location src, blok_Obj sexpr) {
     blok_compiler_validate_sexpr(s, sexpr);
     blok_List * l = blok_list_from_obj(sexpr);
     blok_Obj head_obj = l->items.ptr[0];
-    blok_Symbol head = head_obj.as.data;
-    blok_Binding * it = NULL;
-    blok_vec_find(it, &s->globals, head == it->name);
-    if(it == NULL) {
-        blok_fatal_error(src, "Unbound symbol");
+    blok_Binding head = {0};
+    if(!blok_compiler_lookup_obj(s, head_obj, &head)) {
+        blok_fatal_error(&s->locations, src, "Unbound symbol");
     } else {
-        blok_TypeData type_data = blok_type_get_data(s, it->type);
-        if(type_data.tag == BLOK_TYPETAG_SIGNATURE) {
-            return type_data.as.signature.return_type;
+        if(blok_type_get_tag(s, head.type) == BLOK_TYPETAG_SIGNATURE) {
+            return blok_signature_from_type(s, head.type)->return_type;
         } else {
-            blok_fatal_error(src, "Expected function");
+            blok_fatal_error(&s->locations, src, "Expected function");
         }
     }
 }
 
-blok_Type blok_compiler_infer_typeof_expr_symbol(blok_State * s, blok_SourceInfo * src, blok_Symbol sym) {
-    (void) s;
+blok_Type blok_compiler_infer_typeof_expr_symbol(blok_State * s, blok_Location src, blok_Obj symbol_obj) {
     blok_Binding b = {0};
-    if(!blok_compiler_lookup_symbol(s, sym, &b)) {
-        blok_fatal_error(src, "Undefined symbol: %s", blok_symbol_get_data(s, sym).buf);
+    if(!blok_compiler_lookup_obj(s, symbol_obj, &b)) {
+        blok_fatal_error(&s->locations, src, "Undefined symbol: %s", blok_symbol_get_data(s, blok_symbol_from_obj(symbol_obj)).buf);
     }
     return b.type;
 }
 
 //NOTE, an expr means it is evaluated, a value means it is not
-blok_Type blok_compiler_infer_typeof_expr(blok_State * s, blok_SourceInfo * src, blok_Obj expr) {
+blok_Type blok_compiler_infer_typeof_expr_uncached(blok_State * s, blok_Location src, blok_Obj expr) {
     switch(expr.tag) {
         case BLOK_TAG_NIL:
             return blok_type_void(s);
@@ -410,25 +515,52 @@ blok_Type blok_compiler_infer_typeof_expr(blok_State * s, blok_SourceInfo * src,
         case BLOK_TAG_STRING:
             return blok_type_string(s);
         case BLOK_TAG_SYMBOL:
-            return blok_compiler_infer_typeof_expr_symbol(s, src, expr.as.data);
+            return blok_compiler_infer_typeof_expr_symbol(s, src, expr);
         case BLOK_TAG_LIST:
             return blok_compiler_infer_typeof_expr_list(s, src, expr);
         default:
-            blok_fatal_error(NULL, "TODO: implement type inference for these types");
+            blok_fatal_error(&s->locations, BLOK_LOCATION_NONE, "TODO: implement type inference for these types");
     }
 }
 
+/*every memoized type goes stale, called whenever existing bindings are popped or reset*/
+void blok_compiler_invalidate_inferred_types(blok_State * s) {
+    ++s->binding_epoch;
+}
+
+/* memoizes the type of each symbol and s-expression node of the current form
+ * by its location, so typechecking and codegen only pay for inferring a node
+ * once. Nodes of earlier forms, like promoted function bodies, aren't memoized*/
+blok_Type blok_compiler_infer_typeof_expr(blok_State * s, blok_Location src, blok_Obj expr) {
+    const bool cacheable = expr.location >= s->inferred_base && expr.location != BLOK_LOCATION_NONE
+        && (expr.tag == BLOK_TAG_SYMBOL || expr.tag == BLOK_TAG_LIST);
+    if(!cacheable) {
+        return blok_compiler_infer_typeof_expr_uncached(s, src, expr);
+    }
+    const int32_t slot = (int32_t)(expr.location - s->inferred_base);
+    if(slot < s->inferred_types.items.len) {
+        blok_InferredType cached = s->inferred_types.items.ptr[slot];
+        if(cached.epoch == s->binding_epoch) {
+            return cached.type;
+        }
+    }
+    blok_Type result = blok_compiler_infer_typeof_expr_uncached(s, src, expr);
+    if(slot >= s->inferred_types.items.len) {
+        blok_vec_resize(&s->inferred_types, blok_state_arena(s, BLOK_ARENA_TYPES), slot + 1);
+    }
+    s->inferred_types.items.ptr[slot] = (blok_InferredType){.type = result, .epoch = s->binding_epoch};
+    return result;
+}
+
 bool blok_compiler_type_coercible(blok_State * s, blok_Type to, blok_Type from) {
     if(to == from) {
         return true;
     } else {
-        blok_TypeData t = blok_type_get_data(s, to);
-        blok_TypeData f = blok_type_get_data(s, from);
-        switch(t.tag) {
+        switch(blok_type_get_tag(s, to)) {
             case BLOK_TYPETAG_OBJ:
                 return true;
             case BLOK_TYPETAG_OPTIONAL: 
-                if(f.tag == BLOK_TYPETAG_NIL || from == t.as.optional.type) {
+                if(blok_type_get_tag(s, from) == BLOK_TYPETAG_NIL || from == blok_type_get_item_type(s, to)) {
                     return true;
                 } else {
                     return false;
@@ -440,21 +572,21 @@ bool blok_compiler_type_coercible(blok_State * s, blok_Type to, blok_Type from)
     }
 }
 
-void blok_compiler_typecheck_value(blok_State * s, blok_SourceInfo * src, blok_Type type, blok_Obj value) {
+void blok_compiler_typecheck_value(blok_State * s, blok_Location src, blok_Type type, blok_Obj value) {
     blok_Type value_type = blok_compiler_infer_typeof_value(s, value);
     if(!blok_compiler_type_coercible(s, type, value_type)) {
-        blok_fatal_error(src, "Type mismatch");
+        blok_fatal_error(&s->locations, src, "Type mismatch");
     }
 }
 
-void blok_compiler_typecheck_expr(blok_State * s,  blok_SourceInfo * src, blok_Type type, blok_Obj expr) {
+void blok_compiler_typecheck_expr(blok_State * s,  blok_Location src, blok_Type type, blok_Obj expr) {
     blok_Type value_type = blok_compiler_infer_typeof_expr(s, src, expr);
     if(!blok_compiler_type_coercible(s, type, value_type)) {
-        blok_fatal_error(src, "Type mismatch");
+        blok_fatal_error(&s->locations, src, "Type mismatch");
     }
 }
 
-void blok_compiler_typecheck_arg(blok_State *s, blok_SourceInfo * src, blok_ParamType type, blok_Obj arg) {
+void blok_compiler_typecheck_arg(blok_State *s, blok_Location src, blok_ParamType type, blok_Obj arg) {
     if(type.noeval) {
         blok_compiler_typecheck_value(s, src, type.type, arg);
     } else {
@@ -462,18 +594,18 @@ void blok_compiler_typecheck_arg(blok_State *s, blok_SourceInfo * src, blok_Para
     }
 }
 
-void blok_compiler_typecheck_args(blok_State * s, blok_SourceInfo * src, blok_Signature sig, blok_ListRef args) {
-    if(sig.param_count > args.len) {
-        blok_fatal_error(src, "Incorrect number of arguments, expected at least %d arguments, found %d arguments", sig.param_count, args.len);
+void blok_compiler_typecheck_args(blok_State * s, blok_Location src, const blok_Signature * sig, blok_ListRef args) {
+    if(sig->param_count > args.len) {
+        blok_fatal_error(&s->locations, src, "Incorrect number of arguments, expected at least %d arguments, found %d arguments", sig->param_count, args.len);
     }
-    if(!sig.variadic && sig.param_count != args.len) {
-        blok_fatal_error(src, "Incorrect number of arguments, expected at %d arguments, found %d arguments", sig.param_count, args.len);
+    if(!sig->variadic && sig->param_count != args.len) {
+        blok_fatal_error(&s->locations, src, "Incorrect number of arguments, expected at %d arguments, found %d arguments", sig->param_count, args.len);
     }
-    for(int i = 0; i < sig.param_count; ++i) {
-        blok_compiler_typecheck_arg(s, src, sig.params[i], args.ptr[i]);
+    for(int i = 0; i < sig->param_count; ++i) {
+        blok_compiler_typecheck_arg(s, src, sig->params[i], args.ptr[i]);
     }
-    for(int i = sig.param_count; i < args.len; ++i) {
-        blok_compiler_typecheck_arg(s, src, sig.variadic_args_type, args.ptr[i]);
+    for(int i = sig->param_count; i < args.len; ++i) {
+        blok_compiler_typecheck_arg(s, src, sig->variadic_args_type, args.ptr[i]);
     }
 
     //BLOK_LOG("args are valid!\n");
@@ -497,7 +629,7 @@ blok_Obj blok_compiler_comptime_eval_primitive(blok_State * s, const blok_Primit
 blok_Obj blok_compiler_comptime_eval_function(blok_State * s, const blok_Function * fn, blok_ListRef args) {
     (void)args;
     (void)fn;
-    int checkpoint = s->locals.items.len;
+    int checkpoint = s->locals.bindings.items.len;
     (void)checkpoint;
 
     TODO("Bind parameters to local variables");
@@ -515,29 +647,27 @@ blok_Obj blok_compiler_comptime_eval_list(blok_State *s, blok_Obj obj) {
     assert(l.len >= 0);
 
     if(l.len == 0) {
-        blok_fatal_error(&obj.src_info, "Cannot evaluate empty list");
+        blok_fatal_error(&s->locations, obj.location, "Cannot evaluate empty list");
     }
 
 
     blok_Obj head_obj = l.ptr[0];
     if(head_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&obj.src_info, "Expected symbol");
+        blok_fatal_error(&s->locations, obj.location, "Expected symbol");
     }
     blok_Obj head_value = blok_compiler_comptime_eval(s, head_obj);
     if(head_value.tag == BLOK_TAG_FUNCTION) {
         blok_Function * fn = blok_function_from_obj(head_value);
         blok_ListRef args = blok_slice_tail(l, 1);
-        blok_Signature sig = blok_signature_from_type(s, fn->signature);
-        blok_compiler_typecheck_args(s, &obj.src_info, sig, args);
+        blok_compiler_typecheck_args(s, obj.location, blok_signature_from_type(s, fn->signature), args);
         return blok_compiler_comptime_eval_function(s, blok_function_from_obj(head_value), args);
     } else if(head_value.tag == BLOK_TAG_PRIMITIVE) {
         blok_Primitive * prim = blok_primitive_from_obj(head_value);
         blok_ListRef args = blok_slice_tail(l, 1);
-        blok_Signature sig = blok_signature_from_type(s, prim->signature);
-        blok_compiler_typecheck_args(s, &obj.src_info, sig, args);
+        blok_compiler_typecheck_args(s, obj.location, blok_signature_from_type(s, prim->signature), args);
         return blok_compiler_comptime_eval_primitive(s, blok_primitive_from_obj(head_value), args);
     } else {
-        blok_fatal_error(&head_value.src_info, "Cannot evaluate an object of this type");
+        blok_fatal_error(&s->locations, head_value.location, "Cannot evaluate an object of this type");
     }
 
 
@@ -552,9 +682,9 @@ blok_Obj blok_compiler_comptime_eval(blok_State * s, blok_Obj obj) {
         case BLOK_TAG_STRING:
             return obj;
         case BLOK_TAG_SYMBOL:
-            if(!blok_compiler_lookup_symbol(s, obj.as.data, &b)) {
+            if(!blok_compiler_lookup_obj(s, obj, &b)) {
                 blok_SymbolData data = blok_symbol_get_data(s, obj.as.data);
-                blok_fatal_error(&obj.src_info, "Undefined symbol: %s", data.buf);
+                blok_fatal_error(&s->locations, obj.location, "Undefined symbol: %s", data.buf);
             }
             return b.value;
         case BLOK_TAG_LIST:
@@ -566,22 +696,35 @@ blok_Obj blok_compiler_comptime_eval(blok_State * s, blok_Obj obj) {
     }
 }
 
+/* Values that outlive the toplevel form they were read from have to be moved
+ * out of the form arena. Functions, primitives and types already live in the
+ * persistent arena*/
+blok_Obj blok_compiler_promote(blok_State * s, blok_Obj obj) {
+    switch(obj.tag) {
+        case BLOK_TAG_LIST:
+        case BLOK_TAG_STRING:
+        case BLOK_TAG_KEYVALUE:
+            return blok_obj_copy(&s->persistent_arena, obj);
+        default:
+            return obj;
+    }
+}
+
 void blok_compiler_compile_toplevel_primitive_let(blok_State * s, blok_ListRef args) {
     assert(args.len == 2);
     blok_Symbol name = blok_symbol_from_obj(args.ptr[0]);
+    blok_compiler_resolve(s, blok_state_arena(s, BLOK_ARENA_FORM), &args.ptr[1]);
 
     blok_Binding b = (blok_Binding) {
         .name = name,
-        .type = blok_compiler_infer_typeof_expr(s, &args.ptr[0].src_info, args.ptr[1]),
-        .value = blok_compiler_comptime_eval(s, args.ptr[1]),
+        .type = blok_compiler_infer_typeof_expr(s, args.ptr[0].location, args.ptr[1]),
+        .value = blok_compiler_promote(s, blok_compiler_comptime_eval(s, args.ptr[1])),
         .comptime_known = true,
     };
-    blok_Binding * it = NULL;
-    blok_vec_find(it, &s->globals, it->name == name);
-    if(it != NULL) {
-        blok_fatal_error(&args.ptr[0].src_info, "multiply defined symbol");
+    if(blok_scopes_lookup_current(&s->globals, name) != NULL) {
+        blok_fatal_error(&s->locations, args.ptr[0].location, "multiply defined symbol");
     }
-    blok_vec_append(&s->globals, &s->persistent_arena, b);
+    blok_scopes_define(&s->globals, &s->persistent_arena, b);
 }
 
 void blok_compiler_codegen_type(blok_State * s, blok_Type type) {
@@ -600,30 +743,30 @@ void blok_compiler_codegen_identifier(blok_State * s, blok_Symbol symbol) {
 
 void blok_compiler_parse_parameter_definition(blok_State * s, blok_Obj parameter_description_list, blok_ParamType * type_out, blok_Symbol * name_out) {
     if(parameter_description_list.tag != BLOK_TAG_LIST) {
-        blok_fatal_error(&parameter_description_list.src_info, "Invalid parameter description");
+        blok_fatal_error(&s->locations, parameter_description_list.location, "Invalid parameter description");
     }
     blok_ListRef p = blok_list_from_obj(parameter_description_list)->items;
     if(p.len != 2) {
-        blok_fatal_error(&parameter_description_list.src_info, "invalid parameter list length");
+        blok_fatal_error(&s->locations, parameter_description_list.location, "invalid parameter list length");
     }
     blok_Obj type_name_obj = p.ptr[0];
     if(type_name_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&type_name_obj.src_info, "Type name is not a symbol");
+        blok_fatal_error(&s->locations, type_name_obj.location, "Type name is not a symbol");
     }
     blok_Binding type_binding = {0};
     if(!blok_compiler_lookup_symbol(s, blok_symbol_from_obj(type_name_obj), &type_binding)) {
-        blok_fatal_error(&type_name_obj.src_info, "Undefined symbol");
+        blok_fatal_error(&s->locations, type_name_obj.location, "Undefined symbol");
     }
     if(type_binding.value.tag != BLOK_TAG_TYPE) {
         blok_obj_print(s, type_name_obj, BLOK_STYLE_CODE);
         blok_obj_print(s, type_binding.value, BLOK_STYLE_CODE);
-        blok_fatal_error(&type_name_obj.src_info, "Not a type: %s", blok_tag_get_name(type_binding.value.tag));
+        blok_fatal_error(&s->locations, type_name_obj.location, "Not a type: %s", blok_tag_get_name(type_binding.value.tag));
     }
     blok_Type type = blok_type_from_obj(type_binding.value);
 
     blok_Obj name_obj = p.ptr[1];
     if(name_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&name_obj.src_info, "Parameter name is not a symbol");
+        blok_fatal_error(&s->locations, name_obj.location, "Parameter name is not a symbol");
     }
     *type_out = (blok_ParamType){.type = type, .noeval = false};
     *name_out = blok_symbol_from_obj(name_obj);
@@ -638,7 +781,7 @@ void blok_compiler_parse_parameter_definition(blok_State * s, blok_Obj parameter
 //void blok_compiler_compile_params(blok_State * s, blok_Obj params) {
 //    //blok_ListRef params = params_list->items;
 //    if(params.tag != BLOK_TAG_LIST)  {
-//        blok_fatal_error(&params.src_info, "parameters are not list");
+//        blok_fatal_error(params.location, "parameters are not list");
 //    }
 //    blok_List * p = blok_list_from_obj(params);
 //    fprintf(s->out, "(");
@@ -656,7 +799,7 @@ void blok_compiler_parse_parameter_definition(blok_State * s, blok_Obj parameter
 //                blok_compiler_codegen_param(s, def);
 //                break;
 //            } else {
-//                blok_fatal_error(&obj->src_info, "Expected list, found %s", blok_tag_get_name(obj->tag));
+//                blok_fatal_error(obj->location, "Expected list, found %s", blok_tag_get_name(obj->tag));
 //            }
 //        } else {
 //            blok_ParameterDefinition def = blok_compiler_parse_parameter_definition(s, *obj);
@@ -693,13 +836,13 @@ void blok_compiler_codegen_function_call(blok_State * s, blok_Function * fn, blo
 void blok_compiler_codegen_expression_list(blok_State * s, blok_Obj sexpr) {
     blok_List * l = blok_list_from_obj(sexpr);
     if(l->items.len <= 0) {
-        blok_fatal_error(&sexpr.src_info, "Empty expression");
+        blok_fatal_error(&s->locations, sexpr.location, "Empty expression");
     }
     blok_ListRef args = blok_slice_tail(l->items, 1);
     blok_Binding sexpr_head = {0};
-    if(!blok_compiler_lookup_symbol(s, blok_symbol_from_obj(l->items.ptr[0]), &sexpr_head)) {
+    if(!blok_compiler_lookup_obj(s, l->items.ptr[0], &sexpr_head)) {
         blok_SymbolData data = blok_symbol_get_data(s, blok_symbol_from_obj(l->items.ptr[0]));
-        blok_fatal_error(&sexpr.src_info, "Unknown symbol: %s", data.buf);
+        blok_fatal_error(&s->locations, sexpr.location, "Unknown symbol: %s", data.buf);
     }
     //TODO("A more advanced way of handling a function call");
     /*
@@ -711,15 +854,15 @@ void blok_compiler_codegen_expression_list(blok_State * s, blok_Obj sexpr) {
     if(sexpr_head.value.tag == BLOK_TAG_PRIMITIVE) {
         assert(args.len != l->items.len);
         //TODO typecheck
-        //blok_compiler_typecheck_args(s, &sexpr.src_info, blok_signature_from_type(s, fn->signature), args);
+        //blok_compiler_typecheck_args(s, sexpr.location, blok_signature_from_type(s, fn->signature), args);
         blok_compiler_codegen_primitive(s, blok_primitive_from_obj(sexpr_head.value), args);
     } else if(sexpr_head.value.tag == BLOK_TAG_FUNCTION) {
         blok_Function * fn = blok_function_from_obj(sexpr_head.value);
-        blok_compiler_typecheck_args(s, &sexpr.src_info, blok_signature_from_type(s, fn->signature), args);
+        blok_compiler_typecheck_args(s, sexpr.location, blok_signature_from_type(s, fn->signature), args);
         blok_compiler_codegen_function_call(s, blok_function_from_obj(sexpr_head.value), args);
     } else {
         blok_obj_print(s, sexpr_head.value, BLOK_STYLE_CODE);
-        blok_fatal_error(&sexpr.src_info, "Invalid s-expression head: %s", blok_tag_get_name(sexpr_head.value.tag));
+        blok_fatal_error(&s->locations, sexpr.location, "Invalid s-expression head: %s", blok_tag_get_name(sexpr_head.value.tag));
     }
 }
 
@@ -727,8 +870,8 @@ void blok_compiler_codegen_expression_symbol(blok_State *s, blok_Obj symbol_obj)
     assert(symbol_obj.tag == BLOK_TAG_SYMBOL);
     blok_Symbol sym = blok_symbol_from_obj(symbol_obj);
     blok_Binding result = {0};
-    if(!blok_compiler_lookup_symbol(s, sym, &result)) {
-        blok_fatal_error(&symbol_obj.src_info, "Undefined symbol");
+    if(!blok_compiler_lookup_obj(s, symbol_obj, &result)) {
+        blok_fatal_error(&s->locations, symbol_obj.location, "Undefined symbol");
     }
 
     //blok_binding_print(s, &result);
@@ -746,14 +889,30 @@ void blok_compiler_codegen_expression_symbol(blok_State *s, blok_Obj symbol_obj)
     }
 }
 
+/*emits a c string literal, reads exactly `items.len` characters since the string may be borrowed*/
+void blok_compiler_codegen_string(blok_State * s, const blok_String * str) {
+    fputc('"', s->out);
+    for(int32_t i = 0; i < str->items.len; ++i) {
+        const char ch = str->items.ptr[i];
+        switch(ch) {
+            case '\n': fputs("\\n", s->out); break;
+            case '\t': fputs("\\t", s->out); break;
+            case '"':  fputs("\\\"", s->out); break;
+            case '\\': fputs("\\\\", s->out); break;
+            default:   fputc(ch, s->out); break;
+        }
+    }
+    fputc('"', s->out);
+}
+
 void blok_compiler_codegen_expression(blok_State * s, blok_Obj expr) {
-    //blok_Type t = blok_compiler_infer_typeof_expr(s, &expr.src_info, expr);
+    //blok_Type t = blok_compiler_infer_typeof_expr(s, expr.location, expr);
     //blok_TypeData td = blok_type_get_data(s, t);
     //if(td.tag == BLOK_TYPETAG_VOID) {
     //    printf("provided expression: ");
     //    blok_obj_print(s, expr, BLOK_STYLE_CODE);
     //    printf("\n");
-    //    blok_fatal_error(&expr.src_info, "provided expression returns void");
+    //    blok_fatal_error(expr.location, "provided expression returns void");
     //}
     //printf("codegen expr: ");
     //blok_obj_print(s, expr, BLOK_STYLE_CODE);
@@ -771,6 +930,9 @@ void blok_compiler_codegen_expression(blok_State * s, blok_Obj expr) {
         case BLOK_TAG_SYMBOL:
             blok_compiler_codegen_expression_symbol(s, expr);
             break;
+        case BLOK_TAG_STRING:
+            blok_compiler_codegen_string(s, blok_string_from_obj(expr));
+            break;
         default:
             LOG("\n%s\n", blok_tag_get_name(expr.tag));
             TODO("");
@@ -803,7 +965,7 @@ void blok_compiler_codegen_primitive_when(blok_State *s, blok_ListRef args) {
 
 void blok_compiler_codegen_primitive_expr(blok_State * s, blok_ListRef args) {
     if(args.len != 3) {
-        blok_fatal_error(NULL, "Expected arguments to #expr in the form (#expr value operator value)");
+        blok_fatal_error(&s->locations, BLOK_LOCATION_NONE, "Expected arguments to #expr in the form (#expr value operator value)");
     }
 
     blok_Obj lhs = args.ptr[0];
@@ -898,19 +1060,19 @@ void blok_compiler_codegen_primitive(blok_State *s, const blok_Primitive * prim,
 
 void blok_compiler_codegen_statement(blok_State * s, blok_Obj statement) {
     if(statement.tag != BLOK_TAG_LIST) {
-        blok_fatal_error(&statement.src_info, "Expected s-expression");
+        blok_fatal_error(&s->locations, statement.location, "Expected s-expression");
     }
     blok_ListRef stmt = blok_list_from_obj(statement)->items;
     if(stmt.len < 1) {
-        blok_fatal_error(&statement.src_info, "empty statementession");
+        blok_fatal_error(&s->locations, statement.location, "empty statementession");
     }
     blok_Obj name_obj = stmt.ptr[0];
     if(name_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&name_obj.src_info, "Expected symbol");
+        blok_fatal_error(&s->locations, name_obj.location, "Expected symbol");
     }
     blok_Binding sexpr_head = {0};
-    if(!blok_compiler_lookup_symbol(s, blok_symbol_from_obj(name_obj), &sexpr_head)) {
-        blok_fatal_error(&name_obj.src_info, "Undefined symbol: %s", blok_symbol_get_data(s, blok_symbol_from_obj(name_obj)).buf);
+    if(!blok_compiler_lookup_obj(s, name_obj, &sexpr_head)) {
+        blok_fatal_error(&s->locations, name_obj.location, "Undefined symbol: %s", blok_symbol_get_data(s, blok_symbol_from_obj(name_obj)).buf);
     }
     blok_ListRef args = blok_slice_tail(stmt, 1);
     assert(args.len != stmt.len);
@@ -921,7 +1083,7 @@ void blok_compiler_codegen_statement(blok_State * s, blok_Obj statement) {
         case BLOK_TAG_FUNCTION:
             TODO("codegen function call statement");
         default:
-            blok_fatal_error(&statement.src_info, "Invalid statement");
+            blok_fatal_error(&s->locations, statement.location, "Invalid statement");
     }
     //blok_compiler_codegen_expression(s, statement);
 }
@@ -931,7 +1093,7 @@ void blok_compiler_codegen_body(blok_State * s, blok_ListRef args) {
     s->indent++;
     for(blok_Obj * obj = args.ptr; obj < args.ptr + args.len; ++obj) {
         if(obj->tag != BLOK_TAG_LIST) {
-            blok_fatal_error(&obj->src_info, "Expected list");
+            blok_fatal_error(&s->locations, obj->location, "Expected list");
         }
         blok_compiler_codegen_statement(s, *obj);
     }
@@ -955,81 +1117,99 @@ void blok_compiler_codegen_body(blok_State * s, blok_ListRef args) {
 //}
 
 void blok_compiler_bind_function(blok_State *s , blok_Function def) {
-    blok_Function * fn = blok_arena_alloc(&s->persistent_arena, sizeof(blok_Function));
+    blok_Function * fn = blok_function_allocate(&s->persistent_arena);
     *fn = def;
+    const int32_t param_count = blok_signature_from_type(s, def.signature)->param_count;
+    fn->param_names = blok_arena_memdup(&s->persistent_arena, def.param_names, param_count * sizeof(blok_Symbol));
     blok_Binding binding = (blok_Binding){
         .name = def.name,
         .type = def.signature,
         .value = blok_obj_from_function(fn),
     };
-    blok_vec_append(&s->globals, &s->persistent_arena, binding);
+    blok_scopes_define(&s->globals, &s->persistent_arena, binding);
+
+    /*resolved once the function itself is bound so recursive calls resolve too*/
+    blok_compiler_resolve_body(s, blok_state_arena(s, BLOK_ARENA_FORM), def.body);
+
+    /*the body is kept around for comptime evaluation*/
+    fn->body.ptr = blok_arena_alloc(&s->persistent_arena, def.body.len * sizeof(blok_Obj));
+    for(int32_t i = 0; i < def.body.len; ++i) {
+        fn->body.ptr[i] = blok_compiler_promote(s, def.body.ptr[i]);
+        blok_compiler_forget_locals(&s->persistent_arena, &fn->body.ptr[i]);
+    }
 }
 
-void blok_compiler_bind_params(blok_State *s, blok_Function def) {
-    blok_Signature sig = blok_signature_from_type(s, def.signature);
-    for(int i = 0; i < sig.param_count; ++i) {
+/*`params` are the parameter descriptions `def` was parsed from, they locate errors*/
+void blok_compiler_bind_params(blok_State *s, blok_Function def, blok_ListRef params) {
+    const blok_Signature * sig = blok_signature_from_type(s, def.signature);
+    blok_scopes_push(&s->locals, &s->persistent_arena);
+    for(int i = 0; i < sig->param_count; ++i) {
         blok_Binding binding = (blok_Binding){
             .name = def.param_names[i],
-            .type = sig.params[i].type,
+            .type = sig->params[i].type,
             .value = blok_obj_from_symbol(def.param_names[i]), //TODO figure out how to store references to compiled variables that don't have a compile time known value
         };
         //TODO create a procedure for binding a new local
-        //
-
-        //TODO use a local arena not the persistent arena
-        blok_vec_append(&s->locals, &s->persistent_arena, binding);
+        if(blok_scopes_lookup_current(&s->locals, binding.name) != NULL) {
+            const blok_Obj name_obj = blok_list_from_obj(params.ptr[i])->items.ptr[1];
+            blok_fatal_error(&s->locations, name_obj.location, "Multiply defined parameter: %s", blok_symbol_get_data(s, binding.name).buf);
+        }
+        blok_scopes_define(&s->locals, &s->persistent_arena, binding);
     }
 } 
 
 blok_Function blok_compiler_parse_function_definition(blok_State *s, blok_ListRef args) {
     if(args.len <= 0) {
-        blok_fatal_error(NULL, "Empty function definition");
+        blok_fatal_error(&s->locations, BLOK_LOCATION_NONE, "Empty function definition");
     } else if(args.len <= 1) {
-        blok_fatal_error(&args.ptr[0].src_info, "Invalid function definition, expected 'Type Name Params Body...' only found 'Type'");
+        blok_fatal_error(&s->locations, args.ptr[0].location, "Invalid function definition, expected 'Type Name Params Body...' only found 'Type'");
     } else if(args.len <= 2) {
-        blok_fatal_error(&args.ptr[0].src_info, "Invalid function definition, expected 'Type Name Params Body...' only found 'Type Name'");
+        blok_fatal_error(&s->locations, args.ptr[0].location, "Invalid function definition, expected 'Type Name Params Body...' only found 'Type Name'");
     }
     assert(args.len >= 3);
     blok_Obj return_type_name_obj = args.ptr[0];
     if(return_type_name_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&return_type_name_obj.src_info, "Function return type should be a symbol");
+        blok_fatal_error(&s->locations, return_type_name_obj.location, "Function return type should be a symbol");
     }
     blok_Symbol return_type_name = blok_symbol_from_obj(args.ptr[0]);
     blok_Binding return_type_obj = {0};
     if(!blok_compiler_lookup_symbol(s, return_type_name, &return_type_obj)) {
-        blok_fatal_error(&return_type_name_obj.src_info, "Undefined type");
+        blok_fatal_error(&s->locations, return_type_name_obj.location, "Undefined type");
     }
     blok_Type return_type = return_type_obj.value.as.data;
     blok_Obj name_obj = args.ptr[1];
     if(name_obj.tag != BLOK_TAG_SYMBOL) {
-        blok_fatal_error(&name_obj.src_info, "Function name should be a symbol");
+        blok_fatal_error(&s->locations, name_obj.location, "Function name should be a symbol");
     }
     blok_Symbol name = blok_symbol_from_obj(name_obj);
+    if(blok_scopes_lookup_current(&s->globals, name) != NULL) {
+        blok_fatal_error(&s->locations, name_obj.location, "Multiply defined symbol: %s", blok_symbol_get_data(s, name).buf);
+    }
     blok_Obj params_obj = args.ptr[2];
     if(params_obj.tag != BLOK_TAG_LIST) {
-        blok_fatal_error(&params_obj.src_info, "Function parameter description should be a list, found a %s", blok_tag_get_name(params_obj.tag));
+        blok_fatal_error(&s->locations, params_obj.location, "Function parameter description should be a list, found a %s", blok_tag_get_name(params_obj.tag));
     }
     blok_List * params = blok_list_from_obj(params_obj);
 
-    if(params->items.len > BLOK_PARAMETER_COUNT_MAX) {
-        blok_fatal_error(&params_obj.src_info,
-                "Too many parameters to function, a function may have at most %d parameters, you provided %d",
-                BLOK_PARAMETER_COUNT_MAX,
-                params->items.len);
-    }
+    /*params and names only have to live until the signature is interned and the function is bound*/
+    blok_Arena * scratch = blok_state_arena(s, BLOK_ARENA_SCRATCH);
+    blok_ParamType * param_types = blok_arena_alloc(scratch, (params->items.len + 1) * sizeof(blok_ParamType));
+    blok_Symbol * param_names = blok_arena_alloc(scratch, (params->items.len + 1) * sizeof(blok_Symbol));
 
     blok_Signature sig = {0};
     sig.return_type = return_type;
+    sig.params = param_types;
 
     blok_Function def = {0};
     def.name = name;
+    def.param_names = param_names;
 
     blok_vec_foreach(blok_Obj, it, params) {
         blok_Symbol param_name = {0};
         blok_ParamType param_type = {0};
         blok_compiler_parse_parameter_definition(s, *it, &param_type, &param_name);
-        sig.params[sig.param_count] = param_type;
-        def.param_names[sig.param_count] = param_name;
+        param_types[sig.param_count] = param_type;
+        param_names[sig.param_count] = param_name;
         ++sig.param_count;
     }
     def.signature = blok_signature_intern(s, sig);
@@ -1040,12 +1220,12 @@ blok_Function blok_compiler_parse_function_definition(blok_State *s, blok_ListRe
 void blok_compiler_compile_toplevel_primitive_procedure(blok_State * s, blok_ListRef args) {
     //blok_Obj return_type_name_obj = args.ptr[0];
     //if(return_type_name_obj.tag != BLOK_TAG_SYMBOL) {
-    //    blok_fatal_error(&return_type_name_obj.src_info, "Expected symbol");
+    //    blok_fatal_error(return_type_name_obj.location, "Expected symbol");
     //}
     //blok_Symbol return_type_name = blok_symbol_from_obj(args.ptr[0]);
     //blok_Binding return_type_obj = {0};
     //if(!blok_compiler_lookup_symbol(s, return_type_name, &return_type_obj)) {
-    //    blok_fatal_error(&return_type_name_obj.src_info, "Undefined type");
+    //    blok_fatal_error(return_type_name_obj.location, "Undefined type");
     //}
     //blok_Type return_type = return_type_obj.value.as.data;
     //blok_Symbol name = blok_symbol_from_obj(args.ptr[1]);
@@ -1054,23 +1234,24 @@ void blok_compiler_compile_toplevel_primitive_procedure(blok_State * s, blok_Lis
     //s->locals.items.len = 0;
     //for(blok_Obj * param = params->items.ptr; param < params->items.ptr + params->items.len; ++param) {
     //    if(param->tag != BLOK_TAG_LIST) {
-    //        blok_fatal_error(&param->src_info, "Expected parameter description list, found %s", blok_tag_get_name(param->tag));
+    //        blok_fatal_error(param->location, "Expected parameter description list, found %s", blok_tag_get_name(param->tag));
     //    }
     //    blok_compiler_compile_parameter(s, blok_list_from_obj(*param)->items);
     //}
+    blok_ArenaMark scratch = blok_arena_mark(blok_state_arena(s, BLOK_ARENA_SCRATCH));
     blok_Function def = blok_compiler_parse_function_definition(s, args);
-    blok_Signature sig = blok_signature_from_type(s, def.signature);
+    const blok_Signature * sig = blok_signature_from_type(s, def.signature);
 
-    blok_compiler_codegen_type(s, sig.return_type);
+    blok_compiler_codegen_type(s, sig->return_type);
     fprintf(s->out, " ");
     blok_compiler_codegen_identifier(s, def.name);
     fprintf(s->out, "(");
     bool first = true;
-    for(int i = 0; i < sig.param_count; ++i) {
+    for(int i = 0; i < sig->param_count; ++i) {
         if(!first) {
             fprintf(s->out, ", ");
         }
-        blok_compiler_codegen_type(s, sig.params[i].type);
+        blok_compiler_codegen_type(s, sig->params[i].type);
         fprintf(s->out, " ");
         blok_compiler_codegen_identifier(s, def.param_names[i]);
     }
@@ -1078,20 +1259,22 @@ void blok_compiler_compile_toplevel_primitive_procedure(blok_State * s, blok_Lis
     blok_ListRef body = blok_slice_tail(args, 3);
     def.body = body;
 
-    blok_compiler_bind_params(s, def);
+    blok_compiler_bind_params(s, def, blok_list_from_obj(args.ptr[2])->items);
     blok_compiler_bind_function(s, def);
     blok_compiler_codegen_body(s, body);
 
-    //reset locals
-    s->locals.items.len = 0;
+    /*popping only touches the entries of the params, the sparse array is kept for the next procedure*/
+    blok_scopes_pop(&s->locals);
+    blok_compiler_invalidate_inferred_types(s);
+    blok_arena_rewind(blok_state_arena(s, BLOK_ARENA_SCRATCH), scratch);
 }
 
 void blok_compiler_apply_toplevel_primitive(blok_State * s, const blok_Primitive * p, blok_ListRef args) {
     //blok_Primitive * p = blok_primitive_from_obj(prim);
-    blok_Signature sig = blok_type_get_data(s, p->signature).as.signature;
-    blok_SourceInfo * src = NULL;
+    const blok_Signature * sig = blok_signature_from_type(s, p->signature);
+    blok_Location src = BLOK_LOCATION_NONE;
     if(args.len > 0) {
-        src = &args.ptr[0].src_info;
+        src = args.ptr[0].location;
     }
     blok_compiler_typecheck_args(s, src, sig, args);
     switch(p->tag) {
@@ -1102,14 +1285,14 @@ void blok_compiler_apply_toplevel_primitive(blok_State * s, const blok_Primitive
             blok_compiler_compile_toplevel_primitive_procedure(s, args);
             break;
         default:
-            blok_fatal_error(NULL, "Not a toplevel primitive");
+            blok_fatal_error(&s->locations, BLOK_LOCATION_NONE, "Not a toplevel primitive");
     }
 }
 
 //void blok_compiler_apply_function(blok_State * s, blok_Obj fn, blok_ListRef args) {
 //    blok_Function * f = blok_function_from_obj(fn);
 //    blok_Signature sig = f->signature;
-//    blok_compiler_typecheck_args(s, &fn.src_info, sig, args);
+//    blok_compiler_typecheck_args(s, fn.location, sig, args);
 //    TODO("finish");
 //}
 
@@ -1122,7 +1305,7 @@ void blok_compiler_toplevel_sexpr(blok_State * s, blok_Obj sexpr) {
         blok_vec_find(it, &s->toplevel_primitives, it->name == head);
         if(it == NULL) {
             blok_SymbolData data = blok_symbol_get_data(s, head);
-            blok_fatal_error(&sexpr.src_info, "Unknown toplevel symbol: %s", data.buf);
+            blok_fatal_error(&s->locations, sexpr.location, "Unknown toplevel symbol: %s", data.buf);
         } else {
             blok_compiler_apply_toplevel_primitive(s, it, args);
             //blok_Obj head_value = it->value;
@@ -1131,25 +1314,57 @@ void blok_compiler_toplevel_sexpr(blok_State * s, blok_Obj sexpr) {
             //} else if (head_value.tag == BLOK_TAG_FUNCTION) {
             //    blok_compiler_apply_function(s, globals, head_value, args, output);
             //} else {
-            //    blok_fatal_error(NULL, "TODO");
+            //    blok_fatal_error(BLOK_LOCATION_NONE, "TODO");
             //}
         }
 }
 
-//returns a table of globals
-blok_Bindings blok_compiler_toplevel(blok_State * s, blok_List * toplevel) {
+void blok_compiler_toplevel_form(blok_State * s, blok_Obj sexpr) {
+    if(0) {
+        printf("Compiling: ");
+        blok_obj_print(s, sexpr, BLOK_STYLE_CODE);
+        printf("\n");
+    }
+    blok_compiler_validate_sexpr(s, sexpr);
+    blok_compiler_toplevel_sexpr(s, sexpr);
+}
+
+void blok_compiler_prelude(blok_State * s) {
     fprintf(s->out, "#include <stdio.h>\n");
-    for(int32_t i = 0; i < toplevel->items.len; ++i) {
-        blok_Obj sexpr = toplevel->items.ptr[i];
-        if(0) {
-            printf("Compiling: ");
-            blok_obj_print(s, sexpr, BLOK_STYLE_CODE);
-            printf("\n");
-        }
-        blok_compiler_validate_sexpr(s, sexpr);
-        blok_compiler_toplevel_sexpr(s, sexpr);
+}
+
+//returns a table of globals
+/* Compiles toplevel forms as the reader produces them, each form is read into
+ * the form arena which is reset once its code has been emitted, so the objects
+ * read are bounded by the largest form. The location table still grows with
+ * the whole source*/
+blok_Bindings blok_compiler_toplevel(blok_State * s, blok_Reader * r) {
+    blok_Arena * form_arena = blok_state_arena(s, BLOK_ARENA_FORM);
+    blok_compiler_prelude(s);
+    blok_Obj form;
+    for(;;) {
+        /*the memo keeps its capacity, growing it again zero fills the entries of the previous form*/
+        s->inferred_types.items.len = 0;
+        s->inferred_base = blok_location_next(&s->locations);
+        if(!blok_reader_next_form(s, form_arena, r, &form)) break;
+        blok_compiler_toplevel_form(s, form);
+        blok_arena_reset(form_arena);
     }
-    return s->globals;
+    return s->globals.bindings;
+}
+
+/*compiles a file, a pipe or stdin when `path` is "-"*/
+blok_Bindings blok_compiler_compile_file(blok_State * s, const char * path) {
+    blok_profiler_start("compiler_compile_file");
+    blok_Reader r = blok_reader_open(&s->locations, s->persistent_arena.allocator, path);
+    /* a mapping stays put until the reader is closed and values that outlive a
+     * form are promoted and copied out of it. A stream moves its buffer on
+     * every refill, so its strings are always copied*/
+    r.borrow = r.mapped;
+    blok_compiler_toplevel(s, &r);
+    blok_reader_close(&r);
+    blok_profiler_stop("compiler_compile_file");
+    return s->globals.bindings;
 }
 
 #endif /*BLOK_EVALUATOR_C*/
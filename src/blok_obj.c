@@ -29,22 +29,125 @@ void blok_abort(void) {
 typedef struct {
     int line;
     int column;
-    char file[128];
+    const char * file;
 } blok_SourceInfo;
 
 void blok_print_sourceinfo(FILE * fp, blok_SourceInfo src_info) {
     fprintf(fp, "%s:%d:%d\n", src_info.file, src_info.line, src_info.column); 
 }
 
+/* Source locations are kept out of line so a blok_Obj stays small, objects
+ * only carry an id into this table. Id 0 means the location is unknown.
+ * Only a file id and byte offset are stored per location, line and column are
+ * looked up in the line starts of the file when a diagnostic needs them*/
+typedef uint32_t blok_Location;
+#define BLOK_LOCATION_NONE 0
+
+typedef struct {
+    uint32_t file;
+    uint32_t offset;
+} blok_SourcePos;
+
+typedef struct {
+    const char * path;
+    blok_Vec(uint32_t) line_starts; /*byte offset of the first char of every line, ascending*/
+} blok_SourceFile;
+
+/*owned by the state, see blok_State.locations*/
+typedef struct {
+    blok_Arena arena;
+    blok_Vec(blok_SourceFile) files;
+    blok_Vec(blok_SourcePos) positions;
+} blok_LocationTable;
+
+/*copies the path into the table so locations can outlive whoever opened the file*/
+uint32_t blok_location_add_file(blok_LocationTable * t, const char * path) {
+    blok_Arena * a = &t->arena;
+    blok_SourceFile file = {.path = blok_arena_memdup(a, path, strlen(path) + 1)};
+    blok_vec_append(&file.line_starts, a, 0);
+    blok_vec_append(&t->files, a, file);
+    return (uint32_t)t->files.items.len - 1;
+}
+
+/*records that a new line of `file` begins at `offset`*/
+void blok_location_add_line(blok_LocationTable * t, uint32_t file, uint32_t offset) {
+    assert((int32_t)file < t->files.items.len);
+    blok_SourceFile * f = &t->files.items.ptr[file];
+    assert(offset > *(blok_vec_end(&f->line_starts) - 1));
+    blok_vec_append(&f->line_starts, &t->arena, offset);
+}
+
+blok_Location blok_location_make(blok_LocationTable * t, uint32_t file, uint32_t offset) {
+    blok_vec_append(&t->positions, &t->arena, ((blok_SourcePos){file, offset}));
+    return (blok_Location)t->positions.items.len;
+}
+
+/*the location the next call to blok_location_make returns*/
+blok_Location blok_location_next(const blok_LocationTable * t) {
+    return (blok_Location)t->positions.items.len + 1;
+}
+
+/*computes line and column, file is NULL for BLOK_LOCATION_NONE*/
+blok_SourceInfo blok_location_get(const blok_LocationTable * t, blok_Location location) {
+    if(location == BLOK_LOCATION_NONE) return (blok_SourceInfo){0};
+    assert((int32_t)location <= t->positions.items.len);
+    const blok_SourcePos pos = t->positions.items.ptr[location - 1];
+    const blok_SourceFile * f = &t->files.items.ptr[pos.file];
+
+    /*last line that starts at or before the offset*/
+    int32_t lo = 0;
+    int32_t hi = f->line_starts.items.len - 1;
+    while(lo < hi) {
+        const int32_t mid = lo + (hi - lo + 1) / 2;
+        if(f->line_starts.items.ptr[mid] <= pos.offset) lo = mid; else hi = mid - 1;
+    }
+    return (blok_SourceInfo){
+        .line = lo + 1,
+        .column = (int)(pos.offset - f->line_starts.items.ptr[lo]),
+        .file = f->path,
+    };
+}
+
+void blok_location_table_free(blok_LocationTable * t) {
+    blok_arena_free(&t->arena);
+    *t = (blok_LocationTable){0};
+}
+
+void blok_location_run_tests(void) {
+    blok_profiler_do("location_run_tests") {
+        blok_LocationTable t = {0};
+        const uint32_t file = blok_location_add_file(&t, "test.blok");
+        const blok_Location first = blok_location_make(&t, file, 3);
+        blok_location_add_line(&t, file, 10);
+        blok_location_add_line(&t, file, 11);
+        blok_location_add_line(&t, file, 25);
+        const blok_Location last = blok_location_make(&t, file, 30);
+
+        blok_SourceInfo info = blok_location_get(&t, first);
+        assert(info.line == 1 && info.column == 3 && strcmp(info.file, "test.blok") == 0);
+        info = blok_location_get(&t, last);
+        assert(info.line == 4 && info.column == 5);
+        info = blok_location_get(&t, blok_location_make(&t, file, 10));
+        assert(info.line == 2 && info.column == 0);
+        assert(blok_location_get(&t, BLOK_LOCATION_NONE).file == NULL);
+        (void)first;
+        (void)last;
+        (void)info;
+        blok_location_table_free(&t);
+    }
+}
+
 BLOK_NORETURN
 void blok_fatal_error_internal(
-        blok_SourceInfo *src_info, const char *c_file,
-        int c_line, const char *restrict fmt, ...) {
+        const blok_LocationTable * locations, blok_Location location,
+        const char *c_file, int c_line, const char *restrict fmt, ...) {
     fflush(stdout);
     fflush(stderr);
     fprintf(stderr, "\n\nERROR: \n    ");
-    if (src_info != NULL) {
-        blok_print_sourceinfo(stderr, *src_info);
+    assert((locations != NULL || location == BLOK_LOCATION_NONE) && "a location needs the table it was made in");
+    const blok_SourceInfo src_info = locations == NULL ? (blok_SourceInfo){0} : blok_location_get(locations, location);
+    if (src_info.file != NULL) {
+        blok_print_sourceinfo(stderr, src_info);
     }
     fprintf(stderr, "    Note, Error emitted from\n");
     fprintf(stderr, "        %s:%d:0:\n    ", c_file, c_line);
@@ -57,9 +160,10 @@ void blok_fatal_error_internal(
     blok_abort();
 }
 
-/*note, fmt is passed as part of __VA_ARGS__ to avoid the extra comma problem*/
-#define blok_fatal_error(src_info, /*fmt,*/ ...) \
-    blok_fatal_error_internal(src_info, __FILE__, __LINE__, __VA_ARGS__ )
+/* note, fmt is passed as part of __VA_ARGS__ to avoid the extra comma problem.
+ * `locations` may be NULL when the location is BLOK_LOCATION_NONE*/
+#define blok_fatal_error(locations, location, /*fmt,*/ ...) \
+    blok_fatal_error_internal(locations, location, __FILE__, __LINE__, __VA_ARGS__ )
 
 
 
@@ -81,6 +185,19 @@ typedef enum {
 typedef int32_t blok_Symbol;
 #define BLOK_SYMBOL_NIL 0 
 
+/* What a symbol occurrence was bound to when it was resolved, stored next to
+ * the symbol id in the obj. The kind is kept in the top bits, the index is
+ * into the globals or into the locals of the procedure being compiled, whose
+ * first slots are its params*/
+typedef uint32_t blok_Ref;
+#define BLOK_REF_NONE 0
+#define BLOK_REF_GLOBAL 1
+#define BLOK_REF_LOCAL 2
+#define BLOK_REF_INDEX_BITS 28
+#define blok_ref_make(kind, index) (((blok_Ref)(kind) << BLOK_REF_INDEX_BITS) | (blok_Ref)(index))
+#define blok_ref_kind(ref) ((ref) >> BLOK_REF_INDEX_BITS)
+#define blok_ref_index(ref) ((int32_t)((ref) & (((blok_Ref)1 << BLOK_REF_INDEX_BITS) - 1)))
+
 typedef int32_t blok_Type;
 
 typedef enum {
@@ -107,6 +224,7 @@ typedef enum {
     BLOK_TYPETAG_UNION,
     BLOK_TYPETAG_OPTIONAL
 } blok_TypeTag;
+#define BLOK_TYPETAG_COUNT (BLOK_TYPETAG_OPTIONAL + 1)
 
 typedef struct {
     blok_Type item_type;
@@ -136,10 +254,10 @@ typedef struct {
     bool noeval;
 } blok_ParamType;
 
-#define BLOK_PARAMETER_COUNT_MAX 8
+/*a view, interned signatures keep their params in the type pool of the state*/
 typedef struct blok_Signature {
     blok_Type return_type;
-    blok_ParamType params[BLOK_PARAMETER_COUNT_MAX];
+    const blok_ParamType * params;
     int32_t param_count;
     bool variadic;
     blok_ParamType variadic_args_type;
@@ -181,19 +299,34 @@ const char * blok_tag_get_name(blok_Tag tag) {
 
 typedef struct {
     blok_Tag tag; 
+
+    /*debugging info*/
+    blok_Location location;
+
     union {
         void * ptr;
         int data;
+        struct {
+            blok_Symbol id; /*aliases data*/
+            blok_Ref ref;
+        } symbol;
     } as;
-
-    /*debugging info*/
-    blok_SourceInfo src_info;
 } blok_Obj;
+STATIC_ASSERT(sizeof(blok_Obj) <= 16, obj_fits_in_16_bytes);
+
+/*short lists and strings keep their items inside the header and only spill to the arena when they grow*/
+#define BLOK_LIST_INLINE_CAPACITY 4
+#define BLOK_STRING_INLINE_CAPACITY 15
 
 typedef blok_Slice(blok_Obj) blok_ListRef;
-typedef struct { blok_ListRef items; int32_t cap; blok_Obj _item;} blok_List;
-STATIC_ASSERT(sizeof(blok_List) == sizeof(blok_Vec(blok_Obj)), correct_vec_structure);
-typedef blok_Vec(char) blok_String;
+/* Copies of lists, strings and keyvalues within one arena share the original
+ * and count it in `shares`. A shared object is immutable, it has to be
+ * unshared before it is modified. `owner` tells which arena the object was
+ * allocated in, see blok_arena_id*/
+typedef struct { blok_ListRef items; int32_t cap; blok_Obj _item; blok_Obj inline_items[BLOK_LIST_INLINE_CAPACITY]; int32_t shares; const void * owner;} blok_List;
+STATIC_ASSERT(offsetof(blok_List, shares) == sizeof(blok_SmallVec(blok_Obj, BLOK_LIST_INLINE_CAPACITY)), correct_vec_structure);
+/*the length of a string doesn't count a terminator, strings that borrow their characters from the source have none*/
+typedef struct { blok_Slice(char) items; int32_t cap; char _item; char inline_items[BLOK_STRING_INLINE_CAPACITY]; int32_t shares; const void * owner;} blok_String;
 
 typedef enum {
     BLOK_SUFFIX_NIL = '\0',
@@ -201,16 +334,53 @@ typedef enum {
     BLOK_SUFFIX_BRACKET_PAIR = '[',
 } blok_Suffix;
 
-#define BLOK_SYMBOL_MAX_LEN 64
 #define BLOK_SYMBOL_MAX_SUFFIX_COUNT 8
+
+/* A view of the text of a symbol. Interned symbols point into the string pool
+ * of the state, buf and suffix are both nul terminated*/
 typedef struct {
-    char buf[BLOK_SYMBOL_MAX_LEN];
-    blok_Suffix suffix[BLOK_SYMBOL_MAX_SUFFIX_COUNT];
+    const char * buf;
+    int32_t len;
+    uint32_t hash;
+    const char * suffix; /*blok_Suffix values, NULL means no suffix*/
 } blok_SymbolData;
 
+/* Small immutable data like symbol text and signature params is packed back to
+ * back into large blocks. Blocks are never moved, so pointers into the pool
+ * stay valid for the lifetime of its arena*/
+#define BLOK_POOL_BLOCK_SIZE (64 * 1024)
+#define BLOK_POOL_ALIGNMENT 8
+
+typedef struct {
+    char * block;
+    size_t used;
+    size_t cap;
+} blok_Pool;
+
+void * blok_pool_alloc(blok_Pool * pool, blok_Arena * a, size_t bytes, size_t alignment) {
+    assert(alignment > 0 && alignment <= BLOK_POOL_ALIGNMENT);
+    size_t begin = (pool->used + alignment - 1) & ~(alignment - 1);
+    if(pool->block == NULL || pool->cap < begin || pool->cap - begin < bytes) {
+        pool->cap = bytes > BLOK_POOL_BLOCK_SIZE ? bytes : BLOK_POOL_BLOCK_SIZE;
+        pool->block = blok_arena_alloc(a, pool->cap);
+        begin = 0;
+    }
+    pool->used = begin + bytes;
+    return pool->block + begin;
+}
+
+const char * blok_pool_add_string(blok_Pool * pool, blok_Arena * a, const char * str, size_t len) {
+    char * result = blok_pool_alloc(pool, a, len + 1, 1);
+    memcpy(result, str, len);
+    result[len] = 0;
+    return result;
+}
+
 typedef struct {
     blok_Symbol key;
     blok_Obj value;
+    int32_t shares;
+    const void * owner;
 } blok_KeyValue;
 
 bool blok_paramtype_equal(blok_ParamType l, blok_ParamType r) {
@@ -239,7 +409,7 @@ bool blok_paramtype_equal(blok_ParamType l, blok_ParamType r) {
 typedef struct {
     blok_Type signature;
     blok_Symbol name;
-    blok_Symbol param_names[BLOK_PARAMETER_COUNT_MAX];
+    const blok_Symbol * param_names; /*one per param of the signature*/
     blok_ListRef body;
 } blok_Function;
 
@@ -251,10 +421,93 @@ typedef struct {
     bool comptime_known;
 } blok_Binding;
 
+/*the inferred type of the node at a location, only valid while `epoch` matches blok_State.binding_epoch*/
+typedef struct {
+    blok_Type type;
+    uint32_t epoch;
+} blok_InferredType;
+
 
 typedef blok_Vec(blok_KeyValue) blok_AList;
 typedef blok_Vec(blok_Binding) blok_Bindings;
 
+/* Bindings of nested scopes kept in a sparse set indexed by symbol id, based on
+ * the sset from pimbs. A lookup is a single index no matter how many bindings
+ * exist. Inner bindings shadow outer ones until their scope is popped.
+ * Indices are stored plus one so a zeroed entry means no binding*/
+typedef struct {
+    blok_Bindings bindings;      /*dense, the innermost scope is at the end*/
+    blok_Vec(int32_t) shadowed;  /*per binding, the binding of the same name it hides*/
+    blok_Vec(int32_t) sparse;    /*per symbol id, the innermost binding of that name*/
+    blok_Vec(int32_t) scope_starts;
+} blok_Scopes;
+
+void blok_scopes_push(blok_Scopes * sc, blok_Arena * a) {
+    blok_vec_append(&sc->scope_starts, a, sc->bindings.items.len);
+}
+
+/*unbinds everything defined since the matching push, shadowed bindings become visible again*/
+void blok_scopes_pop(blok_Scopes * sc) {
+    assert(sc->scope_starts.items.len > 0 && "no scope to pop");
+    const int32_t start = sc->scope_starts.items.ptr[--sc->scope_starts.items.len];
+    for(int32_t i = sc->bindings.items.len - 1; i >= start; --i) {
+        sc->sparse.items.ptr[sc->bindings.items.ptr[i].name] = sc->shadowed.items.ptr[i];
+    }
+    sc->bindings.items.len = start;
+    sc->shadowed.items.len = start;
+}
+
+blok_Binding * blok_scopes_lookup(const blok_Scopes * sc, blok_Symbol name) {
+    if(name < 0 || name >= sc->sparse.items.len) return NULL;
+    const int32_t i = sc->sparse.items.ptr[name];
+    return i == 0 ? NULL : &sc->bindings.items.ptr[i - 1];
+}
+
+/*only finds bindings of the innermost scope*/
+blok_Binding * blok_scopes_lookup_current(const blok_Scopes * sc, blok_Symbol name) {
+    blok_Binding * result = blok_scopes_lookup(sc, name);
+    const int32_t start = sc->scope_starts.items.len == 0 ? 0 : sc->scope_starts.items.ptr[sc->scope_starts.items.len - 1];
+    return result != NULL && result - sc->bindings.items.ptr >= start ? result : NULL;
+}
+
+/*callers check for a binding of the same name in the current scope first*/
+blok_Binding * blok_scopes_define(blok_Scopes * sc, blok_Arena * a, blok_Binding binding) {
+    assert(binding.name >= 0);
+    assert(blok_scopes_lookup_current(sc, binding.name) == NULL && "symbol is already defined in this scope");
+    if(binding.name >= sc->sparse.items.len) {
+        blok_vec_resize(&sc->sparse, a, binding.name + 1);
+    }
+    blok_vec_append(&sc->bindings, a, binding);
+    blok_vec_append(&sc->shadowed, a, sc->sparse.items.ptr[binding.name]);
+    sc->sparse.items.ptr[binding.name] = sc->bindings.items.len;
+    return blok_vec_end(&sc->bindings) - 1;
+}
+
+void blok_scopes_run_tests(void) {
+    blok_profiler_do("scopes_run_tests") {
+        blok_Arena a = {0};
+        blok_Scopes sc = {0};
+        blok_scopes_define(&sc, &a, (blok_Binding){.name = 3, .type = 1});
+        blok_scopes_define(&sc, &a, (blok_Binding){.name = 100, .type = 2});
+        assert(blok_scopes_lookup(&sc, 3)->type == 1);
+        assert(blok_scopes_lookup(&sc, 4) == NULL);
+        assert(blok_scopes_lookup(&sc, 1000) == NULL);
+
+        blok_scopes_push(&sc, &a);
+        assert(blok_scopes_lookup_current(&sc, 3) == NULL);
+        blok_scopes_define(&sc, &a, (blok_Binding){.name = 3, .type = 5});
+        blok_scopes_define(&sc, &a, (blok_Binding){.name = 7, .type = 6});
+        assert(blok_scopes_lookup(&sc, 3)->type == 5);
+        assert(blok_scopes_lookup(&sc, 100)->type == 2);
+        blok_scopes_pop(&sc);
+
+        assert(blok_scopes_lookup(&sc, 3)->type == 1);
+        assert(blok_scopes_lookup(&sc, 7) == NULL);
+        assert(sc.bindings.items.len == 2);
+        blok_arena_free(&a);
+    }
+}
+
 typedef enum {
     BLOK_PRIMITIVE_TOPLEVEL_LET,
     BLOK_PRIMITIVE_TOPLEVEL_PROCEDURE,
@@ -275,10 +528,41 @@ typedef struct {
 
 typedef blok_Vec(blok_Primitive) blok_Primitives;
 
+/*address space reserved up front for each of the state's arenas*/
+#define BLOK_STATE_ARENA_RESERVE ((size_t)16 << 30)
+#ifdef BLOK_HUGE_PAGES
+#   define BLOK_STATE_ARENA_HUGE_PAGES true
+#else
+#   define BLOK_STATE_ARENA_HUGE_PAGES false
+#endif
+
+/*indices into blok_State.arenas*/
+typedef enum {
+    BLOK_ARENA_SCRATCH, /*rewound after each procedure is compiled*/
+    BLOK_ARENA_FORM,    /*holds the ast of the toplevel form being compiled*/
+    BLOK_ARENA_TYPES,   /*holds the inferred type of each node of the current form*/
+    BLOK_ARENA_COUNT,
+} blok_ArenaId;
+
 typedef struct {
     blok_Arena persistent_arena;
-    blok_Vec(blok_TypeData) types; 
+
+    /* The type table is split by field. Every type has a tag and a payload,
+     * the payload is the item type of lists and optionals, or an index into
+     * the signatures or fields for those kinds*/
+    blok_Vec(blok_TypeTag) type_tags; 
+    blok_Vec(uint32_t) type_payloads;
+    blok_Vec(uint32_t) type_hashes; /*structural hash of every type*/
+    blok_Vec(blok_Signature) signatures;
+    blok_Vec(blok_Fields) fields;
+    blok_Pool type_pool;            /*params of the interned signatures*/
+    blok_Type * type_index;         /*open addressing hash table, 0 marks an empty slot*/
+    int32_t type_index_cap;         /*always a power of two*/
+    blok_Type simple_types[BLOK_TYPETAG_COUNT]; /*ids of types that are nothing but a tag, 0 until first used*/
     blok_Vec(blok_SymbolData) symbols;
+    blok_Pool symbol_pool;
+    blok_Symbol * symbol_index; /*open addressing hash table, 0 marks an empty slot*/
+    int32_t symbol_index_cap;  /*always a power of two*/
     blok_Vec(blok_Arena) arenas;
 
     //blok_Bindings builtins;
@@ -287,8 +571,12 @@ typedef struct {
     
     
     FILE * out;
-    blok_Bindings globals;
-    blok_Bindings locals;
+    blok_LocationTable locations; /*every location of every object refers into it*/
+    blok_Scopes globals;
+    blok_Scopes locals; /*kept across procedures, each one pushes and pops its own scope*/
+    blok_Vec(blok_InferredType) inferred_types; /*indexed by blok_Location relative to inferred_base, cleared for every form*/
+    blok_Location inferred_base; /*the first location of the form being compiled*/
+    uint32_t binding_epoch; /*bumped whenever a name may stop meaning what it used to*/
     blok_Vec(blok_Primitive) toplevel_primitives;
     int indent;
 } blok_State;
@@ -296,6 +584,11 @@ typedef struct {
 
 
 
+blok_Arena * blok_state_arena(blok_State * s, blok_ArenaId id) {
+    assert((int32_t)id < s->arenas.items.len);
+    return &s->arenas.items.ptr[id];
+}
+
 //blok_Obj blok_make_primitive(blok_Primitive data) {
 //    return (blok_Obj){.tag = BLOK_TAG_PRIMITIVE, .as.data = data};
 //}
@@ -308,41 +601,117 @@ blok_SymbolData blok_symbol_get_data(const blok_State * s, blok_Symbol id) {
     return blok_slice_get(s->symbols.items, id - 1);
 }
 
+/*fnv-1a over the text and the suffix*/
+uint32_t blok_symboldata_hash(blok_SymbolData sym) {
+    uint32_t hash = 2166136261u;
+    for(int32_t i = 0; i < sym.len; ++i) {
+        hash = (hash ^ (unsigned char)sym.buf[i]) * 16777619u;
+    }
+    for(const char * suffix = sym.suffix; suffix != NULL && *suffix != BLOK_SUFFIX_NIL; ++suffix) {
+        hash = (hash ^ (unsigned char)*suffix) * 16777619u;
+    }
+    return hash;
+}
+
 bool blok_symboldata_equal(blok_SymbolData lhs, blok_SymbolData rhs);
 
+void blok_symbol_index_grow(blok_State * s) {
+    if(s->symbol_index != NULL) {
+        blok_arena_reclaim(&s->persistent_arena, s->symbol_index);
+    }
+    s->symbol_index_cap = s->symbol_index_cap == 0 ? 256 : s->symbol_index_cap * 2;
+    s->symbol_index = blok_arena_alloc(&s->persistent_arena, s->symbol_index_cap * sizeof(blok_Symbol));
+    memset(s->symbol_index, 0, s->symbol_index_cap * sizeof(blok_Symbol));
+    const uint32_t mask = s->symbol_index_cap - 1;
+    for(blok_Symbol id = 1; id <= s->symbols.items.len; ++id) {
+        uint32_t i = blok_vec_get(&s->symbols, id - 1).hash & mask;
+        while(s->symbol_index[i] != BLOK_SYMBOL_NIL) i = (i + 1) & mask;
+        s->symbol_index[i] = id;
+    }
+}
+
+/*`sym` may point at temporary memory, new symbols are copied into the string pool*/
 blok_Symbol blok_symboldata_intern(blok_State * s, blok_SymbolData sym) {
-    for(blok_Symbol i = 0; i < s->symbols.items.len; ++i) {
-        if(blok_symboldata_equal(sym, blok_slice_get(s->symbols.items, i))) {
-            return i + 1;
+    blok_profiler_start("symboldata_intern");
+    sym.hash = blok_symboldata_hash(sym);
+    if((s->symbols.items.len + 1) * 2 > s->symbol_index_cap) {
+        blok_symbol_index_grow(s);
+    }
+    const uint32_t mask = s->symbol_index_cap - 1;
+    uint32_t i = sym.hash & mask;
+    for(; s->symbol_index[i] != BLOK_SYMBOL_NIL; i = (i + 1) & mask) {
+        const blok_Symbol id = s->symbol_index[i];
+        if(blok_symboldata_equal(sym, blok_vec_get(&s->symbols, id - 1))) {
+            blok_profiler_stop("symboldata_intern");
+            return id;
         }
     }
-    blok_vec_append(&s->symbols, &s->persistent_arena, sym);
+
+    blok_SymbolData stored = sym;
+    stored.buf = blok_pool_add_string(&s->symbol_pool, &s->persistent_arena, sym.buf, sym.len);
+    if(sym.suffix != NULL && *sym.suffix != BLOK_SUFFIX_NIL) {
+        stored.suffix = blok_pool_add_string(&s->symbol_pool, &s->persistent_arena, sym.suffix, strlen(sym.suffix));
+    } else {
+        stored.suffix = NULL;
+    }
+    blok_vec_append(&s->symbols, &s->persistent_arena, stored);
+    s->symbol_index[i] = s->symbols.items.len;
+    blok_profiler_stop("symboldata_intern");
     return s->symbols.items.len;
 }
 
 blok_Symbol blok_symbol_from_string(blok_State * s, const char * symbol) {
-    blok_SymbolData sym = {0};
-    assert(strlen(symbol) < sizeof(sym.buf));
-    strcpy(sym.buf, symbol);
-    return blok_symboldata_intern(s, sym);
+    return blok_symboldata_intern(s, (blok_SymbolData){.buf = symbol, .len = strlen(symbol)});
 }
 
 
-blok_TypeData blok_type_get_data(const blok_State * s, blok_Type id) {
+blok_TypeTag blok_type_get_tag(const blok_State * s, blok_Type id) {
     assert(id != 0 && "0 is the NULL type");
     assert(id > 0);
-    assert(id <= s->types.items.len);
-    return blok_slice_get(s->types.items, id - 1);
+    assert(id <= s->type_tags.items.len);
+    return blok_slice_get(s->type_tags.items, id - 1);
 }
 
-blok_Signature blok_signature_from_type(const blok_State *s, blok_Type sig) {
-    blok_TypeData data = blok_type_get_data(s, sig);
-    assert(data.tag == BLOK_TYPETAG_SIGNATURE);
-    if(data.tag == BLOK_TYPETAG_SIGNATURE) {
-        return data.as.signature;
-    } else {
-        UNREACHABLE;
+/*the item type of a list or the wrapped type of an optional*/
+blok_Type blok_type_get_item_type(const blok_State * s, blok_Type id) {
+    assert(blok_type_get_tag(s, id) == BLOK_TYPETAG_LIST || blok_type_get_tag(s, id) == BLOK_TYPETAG_OPTIONAL);
+    return blok_slice_get(s->type_payloads.items, id - 1);
+}
+
+/*points into the table, only valid until the next signature is interned*/
+const blok_Signature * blok_signature_from_type(const blok_State *s, blok_Type sig) {
+    assert(blok_type_get_tag(s, sig) == BLOK_TYPETAG_SIGNATURE);
+    return &blok_slice_get(s->signatures.items, blok_slice_get(s->type_payloads.items, sig - 1));
+}
+
+const blok_Fields * blok_type_get_fields(const blok_State * s, blok_Type id) {
+    assert(blok_type_get_tag(s, id) == BLOK_TYPETAG_STRUCT || blok_type_get_tag(s, id) == BLOK_TYPETAG_UNION);
+    return &blok_slice_get(s->fields.items, blok_slice_get(s->type_payloads.items, id - 1));
+}
+
+/*reassembles a type, prefer the accessors for a single field*/
+blok_TypeData blok_type_get_data(const blok_State * s, blok_Type id) {
+    blok_TypeData result = {.tag = blok_type_get_tag(s, id)};
+    switch(result.tag) {
+        case BLOK_TYPETAG_SIGNATURE:
+            result.as.signature = *blok_signature_from_type(s, id);
+            break;
+        case BLOK_TYPETAG_LIST:
+            result.as.list.item_type = blok_type_get_item_type(s, id);
+            break;
+        case BLOK_TYPETAG_OPTIONAL:
+            result.as.optional.type = blok_type_get_item_type(s, id);
+            break;
+        case BLOK_TYPETAG_STRUCT:
+            result.as.struct_.fields = *blok_type_get_fields(s, id);
+            break;
+        case BLOK_TYPETAG_UNION:
+            result.as.union_.fields = *blok_type_get_fields(s, id);
+            break;
+        default:
+            break;
     }
+    return result;
 }
 
 //bool blok_paramtype_equal(blok_ParamType lhs, blok_ParamType rhs) {
@@ -351,15 +720,25 @@ blok_Signature blok_signature_from_type(const blok_State *s, blok_Type sig) {
 //    return true; 
 //}
 
-bool blok_signature_equal(blok_Signature lhs, blok_Signature rhs) {
-    if(lhs.param_count != rhs.param_count) return false;
-    if(lhs.return_type != rhs.return_type) return false;
-    if(lhs.variadic != rhs.variadic) return false;
-    if(lhs.variadic) {
-        if(!blok_paramtype_equal(lhs.variadic_args_type, rhs.variadic_args_type)) return false;
+bool blok_signature_equal(const blok_Signature * lhs, const blok_Signature * rhs) {
+    if(lhs->param_count != rhs->param_count) return false;
+    if(lhs->return_type != rhs->return_type) return false;
+    if(lhs->variadic != rhs->variadic) return false;
+    if(lhs->variadic) {
+        if(!blok_paramtype_equal(lhs->variadic_args_type, rhs->variadic_args_type)) return false;
+    }
+    for(int i = 0; i < lhs->param_count; ++i) {
+        if(!blok_paramtype_equal(lhs->params[i], rhs->params[i])) return false;
     }
-    for(int i = 0; i < lhs.param_count; ++i) {
-        if(!blok_paramtype_equal(lhs.params[i], rhs.params[i])) return false;
+    return true;
+}
+
+bool blok_fields_equal(const blok_Fields * lhs, const blok_Fields * rhs) {
+    if(lhs->items.len != rhs->items.len) return false;
+    for(int i = 0; i < lhs->items.len; ++i) {
+        const blok_FieldType lf = lhs->items.ptr[i];
+        const blok_FieldType rf = rhs->items.ptr[i];
+        if(lf.name != rf.name || lf.type != rf.type) return false;
     }
     return true;
 }
@@ -379,52 +758,171 @@ bool blok_typedata_equal(blok_TypeData lhs, blok_TypeData rhs) {
         case BLOK_TYPETAG_SYMBOL:
             return true;
         case BLOK_TYPETAG_SIGNATURE:
-            return blok_signature_equal(lhs.as.signature, rhs.as.signature);
+            return blok_signature_equal(&lhs.as.signature, &rhs.as.signature);
         case BLOK_TYPETAG_LIST:
             return lhs.as.list.item_type == rhs.as.list.item_type;
         case BLOK_TYPETAG_OPTIONAL:
             return lhs.as.optional.type == rhs.as.optional.type;
-        case BLOK_TYPETAG_STRUCT: {
-            blok_Fields l = lhs.as.struct_.fields;
-            blok_Fields r = rhs.as.struct_.fields;
-            if(l.items.len != r.items.len) {
-                return false;
-            } else {
-                for(int i = 0; i < l.items.len; ++i) {
-                    blok_FieldType lf = l.items.ptr[i];
-                    blok_FieldType rf = r.items.ptr[i];
-                    if(lf.name != rf.name || lf.type != rf.type) return false;
-                }
-            }
+        case BLOK_TYPETAG_STRUCT:
+            return blok_fields_equal(&lhs.as.struct_.fields, &rhs.as.struct_.fields);
+        case BLOK_TYPETAG_UNION:
+            return blok_fields_equal(&lhs.as.union_.fields, &rhs.as.union_.fields);
+    }
+    assert(0 && "Unreachable");
+    return false;
+}
+
+/*compares `type` against the columns of an interned type without reassembling it*/
+bool blok_typedata_equal_interned(const blok_State * s, const blok_TypeData * type, blok_Type id) {
+    if(blok_type_get_tag(s, id) != type->tag) return false;
+    const uint32_t payload = blok_slice_get(s->type_payloads.items, id - 1);
+    switch(type->tag) {
+        case BLOK_TYPETAG_SIGNATURE:
+            return blok_signature_equal(&type->as.signature, &blok_slice_get(s->signatures.items, payload));
+        case BLOK_TYPETAG_LIST:
+            return (uint32_t)type->as.list.item_type == payload;
+        case BLOK_TYPETAG_OPTIONAL:
+            return (uint32_t)type->as.optional.type == payload;
+        case BLOK_TYPETAG_STRUCT:
+            return blok_fields_equal(&type->as.struct_.fields, &blok_slice_get(s->fields.items, payload));
+        case BLOK_TYPETAG_UNION:
+            return blok_fields_equal(&type->as.union_.fields, &blok_slice_get(s->fields.items, payload));
+        default:
             return true;
+    }
+}
+
+uint32_t blok_hash_combine(uint32_t hash, uint32_t value) {
+    return (hash ^ value) * 16777619u;
+}
+
+uint32_t blok_paramtype_hash(uint32_t hash, blok_ParamType param) {
+    return blok_hash_combine(blok_hash_combine(hash, param.type), param.noeval);
+}
+
+uint32_t blok_fields_hash(uint32_t hash, blok_Fields fields) {
+    hash = blok_hash_combine(hash, fields.items.len);
+    blok_vec_foreach(blok_FieldType, field, &fields) {
+        hash = blok_hash_combine(blok_hash_combine(hash, field->name), field->type);
+    }
+    return hash;
+}
+
+/*hashes exactly what blok_typedata_equal compares*/
+uint32_t blok_typedata_hash(blok_TypeData type) {
+    uint32_t hash = blok_hash_combine(2166136261u, type.tag);
+    switch(type.tag) {
+        case BLOK_TYPETAG_BOOL:
+        case BLOK_TYPETAG_VOID:
+        case BLOK_TYPETAG_INT:
+        case BLOK_TYPETAG_NIL:
+        case BLOK_TYPETAG_STRING:
+        case BLOK_TYPETAG_OBJ:
+        case BLOK_TYPETAG_TYPE:
+        case BLOK_TYPETAG_SYMBOL:
+            return hash;
+        case BLOK_TYPETAG_SIGNATURE: {
+            const blok_Signature sig = type.as.signature;
+            hash = blok_hash_combine(hash, sig.return_type);
+            hash = blok_hash_combine(hash, sig.param_count);
+            hash = blok_hash_combine(hash, sig.variadic);
+            if(sig.variadic) hash = blok_paramtype_hash(hash, sig.variadic_args_type);
+            for(int i = 0; i < sig.param_count; ++i) {
+                hash = blok_paramtype_hash(hash, sig.params[i]);
+            }
+            return hash;
         }
-        case BLOK_TYPETAG_UNION: {
-            blok_Fields l = lhs.as.union_.fields;
-            blok_Fields r = rhs.as.union_.fields;
-            if(l.items.len != r.items.len) {
-                return false;
+        case BLOK_TYPETAG_LIST:
+            return blok_hash_combine(hash, type.as.list.item_type);
+        case BLOK_TYPETAG_OPTIONAL:
+            return blok_hash_combine(hash, type.as.optional.type);
+        case BLOK_TYPETAG_STRUCT:
+            return blok_fields_hash(hash, type.as.struct_.fields);
+        case BLOK_TYPETAG_UNION:
+            return blok_fields_hash(hash, type.as.union_.fields);
+    }
+    assert(0 && "Unreachable");
+    return hash;
+}
+
+void blok_type_index_grow(blok_State * s) {
+    if(s->type_index != NULL) {
+        blok_arena_reclaim(&s->persistent_arena, s->type_index);
+    }
+    s->type_index_cap = s->type_index_cap == 0 ? 64 : s->type_index_cap * 2;
+    s->type_index = blok_arena_alloc(&s->persistent_arena, s->type_index_cap * sizeof(blok_Type));
+    memset(s->type_index, 0, s->type_index_cap * sizeof(blok_Type));
+    const uint32_t mask = s->type_index_cap - 1;
+    for(blok_Type id = 1; id <= s->type_tags.items.len; ++id) {
+        uint32_t i = blok_vec_get(&s->type_hashes, id - 1) & mask;
+        while(s->type_index[i] != 0) i = (i + 1) & mask;
+        s->type_index[i] = id;
+    }
+}
+
+/*copies the payload of `type` into the side storage of the table*/
+uint32_t blok_typedata_store_payload(blok_State * s, blok_TypeData type) {
+    blok_Arena * a = &s->persistent_arena;
+    switch(type.tag) {
+        case BLOK_TYPETAG_SIGNATURE: {
+            blok_Signature sig = type.as.signature;
+            if(sig.param_count > 0) {
+                blok_ParamType * params = blok_pool_alloc(&s->type_pool, a, sig.param_count * sizeof(blok_ParamType), BLOK_POOL_ALIGNMENT);
+                memcpy(params, sig.params, sig.param_count * sizeof(blok_ParamType));
+                sig.params = params;
             } else {
-                for(int i = 0; i < l.items.len; ++i) {
-                    blok_FieldType lf = l.items.ptr[i];
-                    blok_FieldType rf = r.items.ptr[i];
-                    if(lf.name != rf.name || lf.type != rf.type) return false;
-                }
+                sig.params = NULL;
             }
-            return true;
+            blok_vec_append(&s->signatures, a, sig);
+            return s->signatures.items.len - 1;
+        }
+        case BLOK_TYPETAG_LIST:
+            return type.as.list.item_type;
+        case BLOK_TYPETAG_OPTIONAL:
+            return type.as.optional.type;
+        case BLOK_TYPETAG_STRUCT:
+        case BLOK_TYPETAG_UNION: {
+            const blok_Fields src = type.tag == BLOK_TYPETAG_STRUCT ? type.as.struct_.fields : type.as.union_.fields;
+            blok_Fields fields = {0};
+            blok_vec_append_slice(&fields, a, src.items.ptr, src.items.len);
+            blok_vec_append(&s->fields, a, fields);
+            return s->fields.items.len - 1;
         }
+        default:
+            return 0;
     }
-    assert(0 && "Unreachable");
-    return false;
 }
 
 blok_Type blok_typedata_intern(blok_State * s, blok_TypeData type) {
-    for(blok_Type i = 0; i < s->types.items.len; ++i) {
-        if(blok_typedata_equal(type, blok_slice_get(s->types.items, i))) {
-            return i + 1;
+    blok_profiler_start("typedata_intern");
+    const uint32_t hash = blok_typedata_hash(type);
+    if((s->type_tags.items.len + 1) * 2 > s->type_index_cap) {
+        blok_type_index_grow(s);
+    }
+    const uint32_t mask = s->type_index_cap - 1;
+    uint32_t i = hash & mask;
+    for(; s->type_index[i] != 0; i = (i + 1) & mask) {
+        const blok_Type id = s->type_index[i];
+        if(blok_vec_get(&s->type_hashes, id - 1) == hash && blok_typedata_equal_interned(s, &type, id)) {
+            blok_profiler_stop("typedata_intern");
+            return id;
         }
     }
-    blok_vec_append(&s->types, &s->persistent_arena, type);
-    return s->types.items.len;
+    const uint32_t payload = blok_typedata_store_payload(s, type);
+    blok_vec_append(&s->type_tags, &s->persistent_arena, type.tag);
+    blok_vec_append(&s->type_payloads, &s->persistent_arena, payload);
+    blok_vec_append(&s->type_hashes, &s->persistent_arena, hash);
+    s->type_index[i] = s->type_tags.items.len;
+    blok_profiler_stop("typedata_intern");
+    return s->type_tags.items.len;
+}
+
+/*types without any payload are interned once and then served from a cache*/
+blok_Type blok_type_simple(blok_State * s, blok_TypeTag tag) {
+    if(s->simple_types[tag] == 0) {
+        s->simple_types[tag] = blok_typedata_intern(s, (blok_TypeData) {.tag = tag});
+    }
+    return s->simple_types[tag];
 }
 
 blok_Type blok_signature_intern(blok_State * s, blok_Signature sig) {
@@ -436,32 +934,32 @@ blok_Type blok_signature_intern(blok_State * s, blok_Signature sig) {
 }
 
 blok_Type blok_type_void(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_VOID});
+    return blok_type_simple(s, BLOK_TYPETAG_VOID);
 }
 
 blok_Type blok_type_int(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_INT});
+    return blok_type_simple(s, BLOK_TYPETAG_INT);
 }
 
 blok_Type blok_type_bool(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_BOOL});
+    return blok_type_simple(s, BLOK_TYPETAG_BOOL);
 }
 
 blok_Type blok_type_type(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_TYPE});
+    return blok_type_simple(s, BLOK_TYPETAG_TYPE);
 }
 
 blok_Type blok_type_symbol(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_SYMBOL});
+    return blok_type_simple(s, BLOK_TYPETAG_SYMBOL);
 }
 
 blok_Type blok_type_string(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_STRING});
+    return blok_type_simple(s, BLOK_TYPETAG_STRING);
 }
 
 
 blok_Type blok_type_obj(blok_State * s) {
-    return blok_typedata_intern(s, (blok_TypeData) {.tag = BLOK_TYPETAG_OBJ});
+    return blok_type_simple(s, BLOK_TYPETAG_OBJ);
 }
 
 blok_Type blok_type_list(blok_State * s, blok_Type item_type) {
@@ -511,7 +1009,7 @@ blok_Obj blok_obj_from_string(blok_String * s) { return blok_obj_from_ptr(s, BLO
 blok_Obj blok_obj_from_function(blok_Function * f) { return blok_obj_from_ptr(f, BLOK_TAG_FUNCTION); }
 blok_Obj blok_obj_from_primitive(blok_Primitive * f) { return blok_obj_from_ptr(f, BLOK_TAG_PRIMITIVE); }
 blok_Obj blok_obj_from_type(blok_Type t) { return (blok_Obj){.tag = BLOK_TAG_TYPE, .as.data = t}; }
-blok_Obj blok_obj_from_symbol(blok_Symbol t) { return (blok_Obj){.tag = BLOK_TAG_SYMBOL, .as.data = t}; }
+blok_Obj blok_obj_from_symbol(blok_Symbol t) { return (blok_Obj){.tag = BLOK_TAG_SYMBOL, .as.symbol = {t, BLOK_REF_NONE}}; }
 
 blok_Obj blok_make_int(int32_t data) {
     return (blok_Obj){.tag = BLOK_TAG_INT, .as.data = data};
@@ -529,13 +1027,38 @@ blok_Obj blok_make_bool(bool cond) {
     return cond ? blok_make_true() : blok_make_false();
 }
 
+/*fixed size objects each get a slab in the arena they are allocated from*/
+typedef enum {
+    BLOK_SLAB_FUNCTION,
+    BLOK_SLAB_KEYVALUE,
+    BLOK_SLAB_LIST,
+    BLOK_SLAB_STRING,
+    BLOK_SLAB_PRIMITIVE,
+    BLOK_SLAB_COUNT,
+} blok_SlabId;
+STATIC_ASSERT(BLOK_SLAB_COUNT <= BLOK_ARENA_SLAB_COUNT, enough_arena_slabs);
+
 blok_Function * blok_function_allocate(blok_Arena * a) {
-    blok_Function * fn = blok_arena_alloc(a, sizeof(blok_Function));
+    blok_Function * fn = blok_arena_slab_alloc(a, BLOK_SLAB_FUNCTION, sizeof(blok_Function));
     memset(fn, 0, sizeof(blok_Function));
     return fn;
 }
 
-blok_List * blok_list_copy(blok_Arena * destination_scope, blok_List const * const list);
+blok_Primitive * blok_primitive_allocate(blok_Arena * a) {
+    blok_Primitive * prim = blok_arena_slab_alloc(a, BLOK_SLAB_PRIMITIVE, sizeof(blok_Primitive));
+    memset(prim, 0, sizeof(blok_Primitive));
+    return prim;
+}
+
+blok_String * blok_string_allocate(blok_Arena * a) {
+    blok_String * str = blok_arena_slab_alloc(a, BLOK_SLAB_STRING, sizeof(blok_String));
+    blok_small_vec_init(str);
+    str->shares = 0;
+    str->owner = blok_arena_id(a);
+    return str;
+}
+
+blok_List * blok_list_copy(blok_Arena * destination_scope, blok_List * list);
 //blok_Obj blok_make_function(blok_Arena * a, blok_List * params, blok_List * body) {
 //    blok_Function * result = blok_function_allocate(a);
 //    result->params = blok_list_copy(a, params);
@@ -547,25 +1070,30 @@ blok_List * blok_list_copy(blok_Arena * destination_scope, blok_List const * con
 blok_List * blok_list_allocate(blok_Arena * a, int32_t initial_capacity) {
     blok_profiler_start("blok_list_allocate");
     assert(a != NULL);
-    blok_List * result = blok_arena_alloc(a, sizeof(blok_List));
+    blok_List * result = blok_arena_slab_alloc(a, BLOK_SLAB_LIST, sizeof(blok_List));
     assert(result != NULL);
-    result->cap = initial_capacity;
-    result->items.len = 0;
-    result->items.ptr = blok_arena_alloc(a, result->cap * sizeof(blok_Obj));
-    assert(result->items.ptr != NULL);
+    blok_small_vec_init(result);
+    result->shares = 0;
+    result->owner = blok_arena_id(a);
+    if(initial_capacity > BLOK_LIST_INLINE_CAPACITY) {
+        result->cap = initial_capacity;
+        result->items.ptr = blok_arena_alloc(a, result->cap * sizeof(blok_Obj));
+        assert(result->items.ptr != NULL);
+    }
     blok_profiler_stop("blok_list_allocate");
     return result;
 }
 
 blok_KeyValue * blok_keyvalue_allocate(blok_Arena * a) {
-    blok_KeyValue * result = blok_arena_alloc(a, sizeof(blok_KeyValue));
+    blok_KeyValue * result = blok_arena_slab_alloc(a, BLOK_SLAB_KEYVALUE, sizeof(blok_KeyValue));
     memset(result, 0, sizeof(blok_KeyValue));
+    result->owner = blok_arena_id(a);
     return result;
 }
 
 blok_Obj blok_make_symbol(blok_Symbol sym) {
     blok_Obj result = {0};
-    result.as.data = sym;
+    result.as.symbol.id = sym;
     result.tag = BLOK_TAG_SYMBOL;
     return result;
 }
@@ -591,7 +1119,7 @@ blok_Primitive * blok_primitive_from_obj(blok_Obj obj) {
 
 blok_Symbol blok_symbol_from_obj(blok_Obj obj) {
     assert(obj.tag == BLOK_TAG_SYMBOL);
-    return obj.as.data;
+    return obj.as.symbol.id;
 }
 
 blok_Type blok_type_from_obj(blok_Obj obj) {
@@ -626,7 +1154,12 @@ bool blok_symbol_empty(blok_Symbol sym) {
 }
 
 bool blok_symboldata_equal(blok_SymbolData lhs, blok_SymbolData rhs) {
-    return strncmp(lhs.buf, rhs.buf, sizeof(lhs.buf)) == 0;
+    const char * lhs_suffix = lhs.suffix == NULL ? "" : lhs.suffix;
+    const char * rhs_suffix = rhs.suffix == NULL ? "" : rhs.suffix;
+    return lhs.hash == rhs.hash
+        && lhs.len == rhs.len
+        && memcmp(lhs.buf, rhs.buf, lhs.len) == 0
+        && strcmp(lhs_suffix, rhs_suffix) == 0;
 }
 
 bool blok_symbol_streql(blok_State * s, const blok_Symbol sym, const char * str) {
@@ -654,7 +1187,7 @@ bool blok_obj_equal(blok_Obj lhs, blok_Obj rhs) {
                         blok_string_from_obj(rhs));
                 break;
             default: 
-                blok_fatal_error(NULL, "Comparison for this tag not implemented yet: %s", blok_tag_get_name(lhs.tag));
+                blok_fatal_error(NULL, BLOK_LOCATION_NONE, "Comparison for this tag not implemented yet: %s", blok_tag_get_name(lhs.tag));
                 break;
         }
     }
@@ -668,41 +1201,106 @@ bool blok_nil_equal(blok_Obj obj) {
 
 void blok_list_append(blok_List* l, blok_Arena * a,  blok_Obj item) {
     blok_profiler_start("blok_list_append");
+    assert(l->shares == 0 && "shared lists are immutable, use blok_list_unshare");
     blok_vec_append(l, a, blok_obj_copy(a, item));
     blok_profiler_stop("blok_list_append");
 }
 
+/*appends `item` without copying it, the list takes over the only reference to it*/
+void blok_list_append_move(blok_List * l, blok_Arena * a, blok_Obj item) {
+    assert(l->shares == 0 && "shared lists are immutable, use blok_list_unshare");
+    blok_vec_append(l, a, item);
+}
+
 blok_Obj blok_obj_copy(blok_Arena * destination_scope, blok_Obj obj);
+blok_Obj blok_obj_deep_copy(blok_Arena * destination_scope, blok_Obj obj);
 
-blok_List * blok_list_copy(blok_Arena * a, blok_List const * const list) {
-    blok_profiler_start("blok_list_copy");
-    blok_List * result = blok_arena_alloc(a, sizeof(blok_List));
-    memset(result, 0, sizeof(blok_List));
+blok_List * blok_list_deep_copy(blok_Arena * a, blok_List const * const list) {
+    blok_profiler_start("blok_list_deep_copy");
+    blok_List * result = blok_list_allocate(a, list->items.len);
+    /*blok_list_allocate reserved room for every item up front*/
     blok_vec_foreach(blok_Obj, it, list) {
-        blok_list_append(result, a, *it);
+        result->items.ptr[result->items.len++] = blok_obj_deep_copy(a, *it);
     }
-    blok_profiler_stop("blok_list_copy");
+    blok_profiler_stop("blok_list_deep_copy");
     return result;
 }
 
+blok_String * blok_string_deep_copy(blok_Arena * a, const blok_String * str) {
+    blok_profiler_start("blok_string_deep_copy");
+    blok_String * result = blok_string_allocate(a);
+    /*the copy owns its characters even when `str` borrows them, and keeps a terminator past its length*/
+    blok_vec_reserve(result, a, str->items.len + 1);
+    blok_vec_append_slice(result, a, str->items.ptr, str->items.len);
+    result->items.ptr[result->items.len] = 0;
+    blok_profiler_stop("blok_string_deep_copy");
+    return result;
+}
+
+blok_KeyValue * blok_keyvalue_deep_copy(blok_Arena * destination_scope, const blok_KeyValue * kv) {
+    blok_profiler_start("blok_keyvalue_deep_copy");
+    blok_KeyValue * result  = blok_keyvalue_allocate(destination_scope);
+    result->key = kv->key;
+    result->value = blok_obj_deep_copy(destination_scope, kv->value);
+    blok_profiler_stop("blok_keyvalue_deep_copy");
+    return result;
+}
+
+/* Copying within the arena that owns the original only counts another share,
+ * anything else is deep copied so it can't outlive the arena it points into.
+ * The items of an object always live at least as long as the object*/
+blok_List * blok_list_copy(blok_Arena * a, blok_List * list) {
+    if(list->owner != blok_arena_id(a)) return blok_list_deep_copy(a, list);
+    ++list->shares;
+    return list;
+}
+
 blok_String * blok_string_copy(blok_Arena * a, blok_String * str) {
-    blok_profiler_start("blok_string_copy");
-    blok_String * result = blok_arena_alloc(a, sizeof(blok_String));
-    memset(result, 0, sizeof(blok_String));
-    blok_vec_foreach(char, ch, str) {
-        blok_vec_append(result, a, *ch);
+    if(str->owner != blok_arena_id(a)) return blok_string_deep_copy(a, str);
+    ++str->shares;
+    return str;
+}
+
+blok_KeyValue * blok_keyvalue_copy(blok_Arena * destination_scope, blok_KeyValue * kv) {
+    if(kv->owner != blok_arena_id(destination_scope)) return blok_keyvalue_deep_copy(destination_scope, kv);
+    ++kv->shares;
+    return kv;
+}
+
+/*returns a list that may be modified, `list_obj` is replaced by a private copy when it is shared*/
+blok_List * blok_list_unshare(blok_Arena * a, blok_Obj * list_obj) {
+    blok_List * list = blok_list_from_obj(*list_obj);
+    if(list->shares == 0) return list;
+    blok_profiler_start("blok_list_unshare");
+    --list->shares;
+    blok_List * result = blok_list_allocate(a, list->items.len);
+    blok_vec_foreach(blok_Obj, it, list) {
+        result->items.ptr[result->items.len++] = blok_obj_copy(a, *it);
     }
-    blok_profiler_stop("blok_string_copy");
+    list_obj->as.ptr = result;
+    blok_profiler_stop("blok_list_unshare");
     return result;
 }
 
+/*returns a string that may be modified, `string_obj` is replaced by a private copy when it is shared*/
+blok_String * blok_string_unshare(blok_Arena * a, blok_Obj * string_obj) {
+    blok_String * str = blok_string_from_obj(*string_obj);
+    if(str->shares == 0) return str;
+    --str->shares;
+    blok_String * result = blok_string_deep_copy(a, str);
+    string_obj->as.ptr = result;
+    return result;
+}
 
-blok_KeyValue * blok_keyvalue_copy(blok_Arena * destination_scope, blok_KeyValue * kv) {
-    blok_profiler_start("blok_keyvalue_copy");
-    blok_KeyValue * result  = blok_keyvalue_allocate(destination_scope);
+/*returns a keyvalue that may be modified, `keyvalue_obj` is replaced by a private copy when it is shared*/
+blok_KeyValue * blok_keyvalue_unshare(blok_Arena * a, blok_Obj * keyvalue_obj) {
+    blok_KeyValue * kv = blok_keyvalue_from_obj(*keyvalue_obj);
+    if(kv->shares == 0) return kv;
+    --kv->shares;
+    blok_KeyValue * result = blok_keyvalue_allocate(a);
     result->key = kv->key;
-    result->value = blok_obj_copy(destination_scope, kv->value);
-    blok_profiler_stop("blok_keyvalue_copy");
+    result->value = blok_obj_copy(a, kv->value);
+    keyvalue_obj->as.ptr = result;
     return result;
 }
 
@@ -716,10 +1314,32 @@ blok_KeyValue * blok_keyvalue_copy(blok_Arena * destination_scope, blok_KeyValue
 //}
 //
 /* All objects use value semantics, so they should be copied when being assigned
- * or passed as parameters
+ * or passed as parameters. Copies are shared where possible, see blok_list_copy
  */
 blok_Obj blok_obj_copy(blok_Arena * destination_scope, blok_Obj obj) {
     blok_profiler_start("blok_obj_copy");
+    blok_Obj result = obj;
+    switch(obj.tag) {
+        case BLOK_TAG_LIST:
+            result.as.ptr = blok_list_copy(destination_scope, blok_list_from_obj(obj));
+            break;
+        case BLOK_TAG_STRING:
+            result.as.ptr = blok_string_copy(destination_scope, blok_string_from_obj(obj));
+            break;
+        case BLOK_TAG_KEYVALUE:
+            result.as.ptr = blok_keyvalue_copy(destination_scope, blok_keyvalue_from_obj(obj));
+            break;
+        default:
+            result = blok_obj_deep_copy(destination_scope, obj);
+            break;
+    }
+    blok_profiler_stop("blok_obj_copy");
+    return result;
+}
+
+/*copies every list, string and keyvalue reachable from `obj` into the destination*/
+blok_Obj blok_obj_deep_copy(blok_Arena * destination_scope, blok_Obj obj) {
+    blok_profiler_start("blok_obj_deep_copy");
     blok_Obj result = blok_make_nil();
     switch(obj.tag) {
         case BLOK_TAG_BOOL:
@@ -730,34 +1350,88 @@ blok_Obj blok_obj_copy(blok_Arena * destination_scope, blok_Obj obj) {
             result = obj;
             break;
         case BLOK_TAG_LIST:
-            result = blok_obj_from_list(blok_list_copy(destination_scope, blok_list_from_obj(obj)));
+            result = blok_obj_from_list(blok_list_deep_copy(destination_scope, blok_list_from_obj(obj)));
             break;
         case BLOK_TAG_STRING:
-            result = blok_obj_from_string(blok_string_copy(destination_scope, blok_string_from_obj(obj)));
+            result = blok_obj_from_string(blok_string_deep_copy(destination_scope, blok_string_from_obj(obj)));
             break;
         case BLOK_TAG_KEYVALUE:
-            result = blok_obj_from_keyvalue(blok_keyvalue_copy(destination_scope, blok_keyvalue_from_obj(obj)));
+            result = blok_obj_from_keyvalue(blok_keyvalue_deep_copy(destination_scope, blok_keyvalue_from_obj(obj)));
             break;
         case BLOK_TAG_ALIST:
-            blok_fatal_error(NULL, "TODO");
+            blok_fatal_error(NULL, BLOK_LOCATION_NONE, "TODO");
             break;
         case BLOK_TAG_FUNCTION:
             TODO("copy function");
             //result = blok_obj_from_function(blok_function_copy(destination_scope, blok_function_from_obj(obj)));
             break;
         case BLOK_TAG_TYPE:
-            blok_fatal_error(NULL, "TODO");
+            blok_fatal_error(NULL, BLOK_LOCATION_NONE, "TODO");
             break;
         case BLOK_TAG_VARIABLE:
-            blok_fatal_error(NULL, "TODO");
+            blok_fatal_error(NULL, BLOK_LOCATION_NONE, "TODO");
             break;
     }
 
-    result.src_info = obj.src_info;
-    blok_profiler_stop("blok_obj_copy");
+    result.location = obj.location;
+    blok_profiler_stop("blok_obj_deep_copy");
     return result;
 }
 
+void blok_obj_copy_run_tests(void) {
+    blok_profiler_do("obj_copy_run_tests") {
+        blok_Arena a = {0};
+        blok_Arena other = {0};
+
+        blok_String * str = blok_string_allocate(&a);
+        blok_vec_append_slice(str, &a, "hello", 5);
+        blok_List * l = blok_list_allocate(&a, 2);
+        blok_vec_append(l, &a, blok_obj_from_string(str));
+        blok_vec_append(l, &a, blok_make_int(1));
+        const blok_Obj original = blok_obj_from_list(l);
+
+        /*copies in the same arena are shared*/
+        blok_Obj copy = blok_obj_copy(&a, original);
+        assert(copy.as.ptr == original.as.ptr && l->shares == 1);
+
+        /*and materialize once they are modified*/
+        blok_List * mutable = blok_list_unshare(&a, &copy);
+        assert(mutable != l && l->shares == 0);
+        assert(mutable->items.ptr[0].as.ptr == str && str->shares == 1);
+        blok_list_append(mutable, &a, blok_make_int(2));
+        assert(mutable->items.len == 3 && l->items.len == 2);
+
+        blok_String * mutable_str = blok_string_unshare(&a, &mutable->items.ptr[0]);
+        mutable_str->items.ptr[0] = 'j';
+        assert(str->items.ptr[0] == 'h' && str->shares == 0);
+
+        /*moved items are neither copied nor shared*/
+        blok_List * owner = blok_list_allocate(&a, 1);
+        blok_list_append_move(owner, &a, original);
+        assert(owner->items.ptr[0].as.ptr == l && l->shares == 0);
+
+        blok_KeyValue * kv = blok_keyvalue_allocate(&a);
+        kv->value = original;
+        blok_Obj kv_copy = blok_obj_copy(&a, blok_obj_from_keyvalue(kv));
+        blok_KeyValue * mutable_kv = blok_keyvalue_unshare(&a, &kv_copy);
+        assert(mutable_kv != kv && kv->shares == 0 && mutable_kv->value.as.ptr == l && l->shares == 1);
+        (void)mutable_kv;
+
+        /*copies into another arena never point back into the original one*/
+        blok_Obj promoted = blok_obj_copy(&other, original);
+        blok_List * promoted_list = blok_list_from_obj(promoted);
+        assert(promoted_list != l && promoted_list->items.ptr[0].as.ptr != str);
+        const blok_String * promoted_str = blok_string_from_obj(promoted_list->items.ptr[0]);
+        assert(promoted_str->items.len == 5 && memcmp(promoted_str->items.ptr, "hello", 5) == 0);
+        (void)promoted_str;
+        (void)promoted_list;
+        (void)mutable_str;
+
+        blok_arena_free(&a);
+        blok_arena_free(&other);
+    }
+}
+
 typedef enum {
     BLOK_STYLE_AESTHETIC,
     BLOK_STYLE_CODE
@@ -771,8 +1445,8 @@ void blok_symbol_fprint(const blok_State *s, FILE * fp, const blok_Symbol symbol
         (void) style;
         blok_SymbolData sym = blok_symbol_get_data(s, symbol);
         fprintf(fp, "%s", sym.buf);
-        for(const blok_Suffix * suffix = sym.suffix; *suffix != BLOK_SUFFIX_NIL; ++suffix) {
-            switch(*suffix) {
+        for(const char * suffix = sym.suffix; suffix != NULL && *suffix != BLOK_SUFFIX_NIL; ++suffix) {
+            switch((blok_Suffix)*suffix) {
                 case BLOK_SUFFIX_ASTERISK:
                     fprintf(fp, "*");
                     break;
@@ -843,12 +1517,12 @@ void blok_obj_fprint(const blok_State * s, FILE * fp, blok_Obj obj, blok_Style s
             case BLOK_TAG_STRING:
                 switch(style) {
                     case BLOK_STYLE_AESTHETIC:
-                        fprintf(fp, "%s", blok_string_from_obj(obj)->items.ptr);
+                        fprintf(fp, "%.*s", (int)blok_string_from_obj(obj)->items.len, blok_string_from_obj(obj)->items.ptr);
                         break;
                     case BLOK_STYLE_CODE:
                         fprintf(fp, "\"");
                         blok_String * str = blok_string_from_obj(obj);
-                        blok_fprint_escape_sequences(fp, str->items.ptr, 32);
+                        blok_fprint_escape_sequences(fp, str->items.ptr, str->items.len < 32 ? str->items.len : 32);
                         fprintf(fp, "\"");
                         break;
                 }
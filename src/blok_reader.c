@@ -3,74 +3,271 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "blok_obj.c"
 
-/* READER */
+/* READER
+ * Regular files are mapped whole, other sources are streamed one toplevel
+ * form at a time. Either way a form is parsed from memory with a plain cursor*/
+#define BLOK_READER_CHUNK_SIZE (64 * 1024)
+
+/*the state of the pre-scan for the end of a form, so it can resume where the buffer ended*/
+typedef struct {
+    uint32_t offset; /*into buf, may be past len when the buffer ends inside an escape*/
+    int32_t depth;
+    bool item;   /*a complete item was read at depth 0*/
+    bool string; /*inside a string*/
+    bool token;  /*inside a token at depth 0*/
+} blok_ReaderScan;
+
 typedef struct {
-    FILE * fp;
-    blok_SourceInfo src_info;
+    const char * buf;
+    uint32_t len;
+    uint32_t offset; /*cursor into buf*/
+    uint32_t base;   /*offset of buf in the source, streams drop the forms they have read*/
+    uint32_t cap;    /*capacity of a streamed buffer*/
+    int fd;          /*the stream buf is refilled from, -1 once it is exhausted or for other sources*/
+    blok_LocationTable * locations; /*where the locations of everything read are recorded*/
+    uint32_t file; /*id in the location table*/
+    blok_Allocator allocator; /*grows and releases a streamed buf*/
+    bool mapped; /*buf is a mapping of the file rather than a streamed copy*/
+    bool owned;  /*buf is released by blok_reader_close*/
+    bool borrow; /*strings may point into buf, only set when buf outlives everything read from it*/
+    blok_ReaderScan scan; /*how far blok_reader_form_buffered got with the next form*/
 } blok_Reader;
 
+/* CHARACTER CLASSES
+ * Looked up in a table rather than through the locale dependent ctype
+ * functions, the reader only understands ascii*/
+#define BLOK_CHAR_WHITESPACE    1
+#define BLOK_CHAR_DIGIT         2
+#define BLOK_CHAR_BEGIN_SYMBOL  4 /*may start a symbol*/
+#define BLOK_CHAR_SYMBOL        8 /*may continue a symbol*/
+#define BLOK_CHAR_STRING_END   16 /*ends a run of plain characters inside a string*/
+
+#define BLOK_CHAR_LETTER(lower, upper) \
+    [lower] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL, [upper] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL
+
+static const uint8_t blok_reader_char_classes[256] = {
+    [' '] = BLOK_CHAR_WHITESPACE, ['\n'] = BLOK_CHAR_WHITESPACE, ['\t'] = BLOK_CHAR_WHITESPACE,
+    ['0'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL, ['1'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL,
+    ['2'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL, ['3'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL,
+    ['4'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL, ['5'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL,
+    ['6'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL, ['7'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL,
+    ['8'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL, ['9'] = BLOK_CHAR_DIGIT | BLOK_CHAR_SYMBOL,
+    BLOK_CHAR_LETTER('a', 'A'), BLOK_CHAR_LETTER('b', 'B'), BLOK_CHAR_LETTER('c', 'C'),
+    BLOK_CHAR_LETTER('d', 'D'), BLOK_CHAR_LETTER('e', 'E'), BLOK_CHAR_LETTER('f', 'F'),
+    BLOK_CHAR_LETTER('g', 'G'), BLOK_CHAR_LETTER('h', 'H'), BLOK_CHAR_LETTER('i', 'I'),
+    BLOK_CHAR_LETTER('j', 'J'), BLOK_CHAR_LETTER('k', 'K'), BLOK_CHAR_LETTER('l', 'L'),
+    BLOK_CHAR_LETTER('m', 'M'), BLOK_CHAR_LETTER('n', 'N'), BLOK_CHAR_LETTER('o', 'O'),
+    BLOK_CHAR_LETTER('p', 'P'), BLOK_CHAR_LETTER('q', 'Q'), BLOK_CHAR_LETTER('r', 'R'),
+    BLOK_CHAR_LETTER('s', 'S'), BLOK_CHAR_LETTER('t', 'T'), BLOK_CHAR_LETTER('u', 'U'),
+    BLOK_CHAR_LETTER('v', 'V'), BLOK_CHAR_LETTER('w', 'W'), BLOK_CHAR_LETTER('x', 'X'),
+    BLOK_CHAR_LETTER('y', 'Y'), BLOK_CHAR_LETTER('z', 'Z'),
+    ['_'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL, ['#'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL,
+    /*operators*/
+    ['<'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL, ['>'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL,
+    ['|'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL, ['='] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL,
+    ['&'] = BLOK_CHAR_BEGIN_SYMBOL | BLOK_CHAR_SYMBOL,
+    ['"'] = BLOK_CHAR_STRING_END, ['\\'] = BLOK_CHAR_STRING_END,
+};
+#undef BLOK_CHAR_LETTER
+
+bool blok_reader_char_is(char ch, uint8_t classes) {
+    return (blok_reader_char_classes[(uint8_t)ch] & classes) != 0;
+}
+
 bool blok_reader_is_whitespace(char ch) {
-    return ch == ' ' || ch == '\n' || ch == '\t';
+    return blok_reader_char_is(ch, BLOK_CHAR_WHITESPACE);
 }
 
-char blok_reader_getc(blok_Reader * r) {
-    char ch = fgetc(r->fp);
-    if(ch == '\n') {
-        ++r->src_info.line;
-        r->src_info.column = 0;
-    } else {
-        ++r->src_info.column;
+/* SCANNING
+ * Finds the end of a run of characters a whole vector at a time, the tail of
+ * the buffer that doesn't fill a vector is handled by the class table.
+ * Define BLOK_READER_NO_SIMD to always use the table*/
+#if defined(__AVX2__) && !defined(BLOK_READER_NO_SIMD)
+#   include <immintrin.h>
+#   define BLOK_READER_VECTOR_WIDTH 32
+#   define blok_reader_vector __m256i
+#   define blok_reader_vector_load(ptr) _mm256_loadu_si256((const __m256i *)(ptr))
+#   define blok_reader_vector_splat(ch) _mm256_set1_epi8(ch)
+#   define blok_reader_vector_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#   define blok_reader_vector_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#   define blok_reader_vector_or(a, b) _mm256_or_si256(a, b)
+#   define blok_reader_vector_and(a, b) _mm256_and_si256(a, b)
+#   define blok_reader_vector_mask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__) && !defined(BLOK_READER_NO_SIMD)
+#   include <emmintrin.h>
+#   define BLOK_READER_VECTOR_WIDTH 16
+#   define blok_reader_vector __m128i
+#   define blok_reader_vector_load(ptr) _mm_loadu_si128((const __m128i *)(ptr))
+#   define blok_reader_vector_splat(ch) _mm_set1_epi8(ch)
+#   define blok_reader_vector_eq(a, b) _mm_cmpeq_epi8(a, b)
+#   define blok_reader_vector_gt(a, b) _mm_cmpgt_epi8(a, b)
+#   define blok_reader_vector_or(a, b) _mm_or_si128(a, b)
+#   define blok_reader_vector_and(a, b) _mm_and_si128(a, b)
+#   define blok_reader_vector_mask(v) ((uint32_t)_mm_movemask_epi8(v))
+#else
+#   define BLOK_READER_VECTOR_WIDTH 0
+#endif
+
+#if BLOK_READER_VECTOR_WIDTH > 0
+#define BLOK_READER_VECTOR_FULL_MASK ((uint32_t)(((uint64_t)1 << BLOK_READER_VECTOR_WIDTH) - 1))
+
+/*bytes in [lo, hi], bytes above 127 are negative and never match*/
+blok_reader_vector blok_reader_vector_in_range(blok_reader_vector v, char lo, char hi) {
+    return blok_reader_vector_and(blok_reader_vector_gt(v, blok_reader_vector_splat(lo - 1)),
+                                  blok_reader_vector_gt(blok_reader_vector_splat(hi + 1), v));
+}
+
+blok_reader_vector blok_reader_vector_whitespace(blok_reader_vector v) {
+    return blok_reader_vector_or(blok_reader_vector_eq(v, blok_reader_vector_splat(' ')),
+           blok_reader_vector_or(blok_reader_vector_eq(v, blok_reader_vector_splat('\n')),
+                                 blok_reader_vector_eq(v, blok_reader_vector_splat('\t'))));
+}
+
+blok_reader_vector blok_reader_vector_symbol(blok_reader_vector v) {
+    /*setting bit 5 folds upper case letters onto lower case ones*/
+    blok_reader_vector result = blok_reader_vector_in_range(blok_reader_vector_or(v, blok_reader_vector_splat(0x20)), 'a', 'z');
+    result = blok_reader_vector_or(result, blok_reader_vector_in_range(v, '0', '9'));
+    result = blok_reader_vector_or(result, blok_reader_vector_in_range(v, '<', '>'));
+    result = blok_reader_vector_or(result, blok_reader_vector_eq(v, blok_reader_vector_splat('_')));
+    result = blok_reader_vector_or(result, blok_reader_vector_eq(v, blok_reader_vector_splat('#')));
+    result = blok_reader_vector_or(result, blok_reader_vector_eq(v, blok_reader_vector_splat('|')));
+    result = blok_reader_vector_or(result, blok_reader_vector_eq(v, blok_reader_vector_splat('&')));
+    return result;
+}
+
+blok_reader_vector blok_reader_vector_string_end(blok_reader_vector v) {
+    return blok_reader_vector_or(blok_reader_vector_eq(v, blok_reader_vector_splat('"')),
+                                 blok_reader_vector_eq(v, blok_reader_vector_splat('\\')));
+}
+#endif
+
+/*index of the first character from `i` on that is not whitespace*/
+uint32_t blok_reader_scan_whitespace(const char * buf, uint32_t i, uint32_t len) {
+#if BLOK_READER_VECTOR_WIDTH > 0
+    for(; i + BLOK_READER_VECTOR_WIDTH <= len; i += BLOK_READER_VECTOR_WIDTH) {
+        const uint32_t stop = ~blok_reader_vector_mask(blok_reader_vector_whitespace(blok_reader_vector_load(buf + i))) & BLOK_READER_VECTOR_FULL_MASK;
+        if(stop != 0) return i + __builtin_ctz(stop);
     }
-    return ch;
+#endif
+    while(i < len && blok_reader_char_is(buf[i], BLOK_CHAR_WHITESPACE)) ++i;
+    return i;
+}
+
+/*index of the first character from `i` on that can't continue a symbol*/
+uint32_t blok_reader_scan_symbol(const char * buf, uint32_t i, uint32_t len) {
+#if BLOK_READER_VECTOR_WIDTH > 0
+    for(; i + BLOK_READER_VECTOR_WIDTH <= len; i += BLOK_READER_VECTOR_WIDTH) {
+        const uint32_t stop = ~blok_reader_vector_mask(blok_reader_vector_symbol(blok_reader_vector_load(buf + i))) & BLOK_READER_VECTOR_FULL_MASK;
+        if(stop != 0) return i + __builtin_ctz(stop);
+    }
+#endif
+    while(i < len && blok_reader_char_is(buf[i], BLOK_CHAR_SYMBOL)) ++i;
+    return i;
+}
+
+/*index of the next '"' or '\\' from `i` on*/
+uint32_t blok_reader_scan_string(const char * buf, uint32_t i, uint32_t len) {
+#if BLOK_READER_VECTOR_WIDTH > 0
+    for(; i + BLOK_READER_VECTOR_WIDTH <= len; i += BLOK_READER_VECTOR_WIDTH) {
+        const uint32_t stop = blok_reader_vector_mask(blok_reader_vector_string_end(blok_reader_vector_load(buf + i)));
+        if(stop != 0) return i + __builtin_ctz(stop);
+    }
+#endif
+    while(i < len && !blok_reader_char_is(buf[i], BLOK_CHAR_STRING_END)) ++i;
+    return i;
+}
+
+uint32_t blok_reader_scan_digits(const char * buf, uint32_t i, uint32_t len) {
+    while(i < len && blok_reader_char_is(buf[i], BLOK_CHAR_DIGIT)) ++i;
+    return i;
+}
+
+/*value of 8 ascii digits at once, the first digit is the most significant*/
+uint32_t blok_reader_parse_8_digits(const char * digits) {
+    uint64_t v;
+    memcpy(&v, digits, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+         (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)v;
+}
+
+char blok_reader_getc(blok_Reader * r) {
+    if(r->offset >= r->len) return 0;
+    return r->buf[r->offset++];
+}
+
+/*records the current position of the reader in the location table*/
+blok_Location blok_reader_location(blok_Reader * r) {
+    return blok_location_make(r->locations, r->file, r->base + r->offset);
 }
 
 bool blok_reader_eof(blok_Reader * r) {
-    return feof(r->fp);
+    return r->offset >= r->len;
 }
 
 char blok_reader_peek(blok_Reader * r) {
-    char ch = fgetc(r->fp);
-    ungetc(ch, r->fp);
-    return ch;
+    if(r->offset >= r->len) return 0;
+    return r->buf[r->offset];
+}
+
+char blok_reader_peek_at(blok_Reader * r, uint32_t offset) {
+    if(offset >= r->len) return 0;
+    return r->buf[offset];
 }
 
 void blok_reader_skip_whitespace(blok_Reader * r) {
     blok_profiler_do("blok_reader_skip_whitespace") {
-        if(blok_reader_eof(r)) {
-            blok_profiler_stop("reader_skip_whitespace");
-            return;
-        }
-        while(blok_reader_is_whitespace(blok_reader_peek(r))) blok_reader_getc(r);
+        r->offset = blok_reader_scan_whitespace(r->buf, r->offset, r->len);
     }
 }
 
 void blok_reader_skip_char(blok_Reader * r, char expected) {
     char ch = blok_reader_getc(r);
     if(ch != expected) {
-        blok_fatal_error(&r->src_info, "Reader expected '%c', got '%c'", expected, ch);
+        blok_fatal_error(r->locations, blok_reader_location(r), "Reader expected '%c', got '%c'", expected, ch);
     }
 }
 
 blok_Obj blok_reader_parse_int(blok_Reader * r) {
     blok_profiler_start("reader_parse_int");
-    assert(isdigit(blok_reader_peek(r)));
-    char buf[1024] = {0};
-    size_t i = 0;
-    while(isdigit(blok_reader_peek(r))) {
-        buf[i++] = blok_reader_getc(r);
-        assert(i < sizeof(buf));
+    assert(blok_reader_char_is(blok_reader_peek(r), BLOK_CHAR_DIGIT));
+    const uint32_t begin = r->offset;
+    const uint32_t end = blok_reader_scan_digits(r->buf, begin, r->len);
+    r->offset = end;
+
+    const char * digits = r->buf + begin;
+    uint32_t count = end - begin;
+    while(count > 1 && *digits == '0') {
+        ++digits;
+        --count;
+    }
+    /*INT32_MAX has 10 digits*/
+    if(count > 10) {
+        blok_fatal_error(r->locations, blok_reader_location(r), "Integer literal is too large");
     }
-    char * end;
-    errno = 0;
-    const long num = strtol(buf, &end, 10);
-    if(errno != 0) {
-        blok_fatal_error(&r->src_info, "Failed to parse integer, errno: %n", errno);
+    uint64_t num = 0;
+    uint32_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        num = num * 100000000 + blok_reader_parse_8_digits(digits + i);
+    }
+    for(; i < count; ++i) {
+        num = num * 10 + (digits[i] - '0');
     }
-    blok_Obj result = blok_make_int(num);
-    result.src_info = r->src_info;
+    if(num > INT32_MAX) {
+        blok_fatal_error(r->locations, blok_reader_location(r), "Integer literal is too large");
+    }
+    blok_Obj result = blok_make_int((int32_t)num);
+    result.location = blok_reader_location(r);
     blok_profiler_stop("reader_parse_int");
     return result;
 }
@@ -83,24 +280,41 @@ blok_Obj blok_reader_parse_string(blok_Arena * a, blok_Reader * r) {
     blok_profiler_start("reader_parse_string");
     blok_reader_skip_char(r, '"');
     int state = BLOK_READER_STATE_BASE;
-    blok_String * str = blok_arena_alloc(a, sizeof(blok_String));
-    memset(str, 0, sizeof(blok_String));
+    blok_String * str = blok_string_allocate(a);
+    const uint32_t plain_end = blok_reader_scan_string(r->buf, r->offset, r->len);
+    if(r->borrow && plain_end > r->offset && blok_reader_peek_at(r, plain_end) == '"') {
+        /*without escapes the string is just a view of the source, see blok_vec_capacity*/
+        str->items.ptr = (char *)r->buf + r->offset;
+        str->items.len = (int32_t)(plain_end - r->offset);
+        str->cap = -str->items.len;
+        r->offset = plain_end + 1;
+        blok_Obj result = blok_obj_from_string(str);
+        result.location = blok_reader_location(r);
+        blok_profiler_stop("reader_parse_string");
+        return result;
+    }
     while(1) {
         char ch = blok_reader_peek(r);
-        if(blok_reader_eof(r)) blok_fatal_error(&r->src_info, "Unexpected end of file when parsing string");
+        if(blok_reader_eof(r)) blok_fatal_error(r->locations, blok_reader_location(r), "Unexpected end of file when parsing string");
         switch(state) {
             case BLOK_READER_STATE_BASE:
                 if(ch == '\\') {
                     state = BLOK_READER_STATE_ESCAPE;
                 } else if (ch == '"') {
                     blok_reader_skip_char(r, '"');
+                    /*materialized strings keep a terminator past their length*/
                     blok_vec_append(str, a, 0);
+                    blok_vec_shrink_to_fit(str, a);
+                    --str->items.len;
                     blok_Obj result =  blok_obj_from_string(str);
-                    result.src_info = r->src_info;
-                    blok_profiler_stop("reader_parse_int");
+                    result.location = blok_reader_location(r);
+                    blok_profiler_stop("reader_parse_string");
                     return result;
                 } else {
-                    blok_vec_append(str, a, blok_reader_getc(r));
+                    /*plain characters are appended straight from the source in one run*/
+                    const uint32_t end = blok_reader_scan_string(r->buf, r->offset, r->len);
+                    blok_vec_append_slice(str, a, (char *)r->buf + r->offset, (int32_t)(end - r->offset));
+                    r->offset = end;
                 }
                 break;
             case BLOK_READER_STATE_ESCAPE:
@@ -120,7 +334,7 @@ blok_Obj blok_reader_parse_string(blok_Arena * a, blok_Reader * r) {
                         blok_vec_append(str, a, '\'');
                         break;
                     default:
-                        blok_fatal_error(&r->src_info, "Unknown string escape: \"\\%c\"", escape);
+                        blok_fatal_error(r->locations, blok_reader_location(r), "Unknown string escape: \"\\%c\"", escape);
                         break;
                 }
                 state = BLOK_READER_STATE_BASE;
@@ -130,52 +344,45 @@ blok_Obj blok_reader_parse_string(blok_Arena * a, blok_Reader * r) {
 }
 
 
-bool blok_reader_is_operator_symbol_char(char ch) {
-    return ch == '<' || ch == '|' || ch == '>' || ch == '=' || ch == '&';
-}
-
 bool blok_reader_is_begin_symbol_char(char ch) {
-    return isalpha(ch) || ch == '#' || ch == '_'|| blok_reader_is_operator_symbol_char(ch);
+    return blok_reader_char_is(ch, BLOK_CHAR_BEGIN_SYMBOL);
 }
 
 bool blok_reader_is_symbol_char(char ch) {
-    return ch == '_' || ch == '#' || blok_reader_is_operator_symbol_char(ch) || isalpha(ch) || isdigit(ch);
+    return blok_reader_char_is(ch, BLOK_CHAR_SYMBOL);
 }
 
 blok_Obj blok_reader_parse_obj(blok_State * s, blok_Arena * b, blok_Reader * r);
 
 blok_Obj blok_reader_parse_symbol(blok_State * s, blok_Arena * a, blok_Reader* r) {
     blok_profiler_start("reader_parse_symbol");
-    blok_SymbolData sym = {0};
-    uint32_t i = 0;
+    char suffix[BLOK_SYMBOL_MAX_SUFFIX_COUNT + 1] = {0};
 
-    while(blok_reader_is_symbol_char(blok_reader_peek(r))) {
-        sym.buf[i++] = blok_reader_getc(r);
-        if(i + 2 > sizeof(sym.buf)) {
-            blok_fatal_error(&r->src_info, "symbol too long, %s\n", sym.buf);
-        }
-    }
+    /*the text is interned straight from the source, it is only copied the first time it is seen*/
+    const uint32_t end = blok_reader_scan_symbol(r->buf, r->offset, r->len);
+    blok_SymbolData sym = {.buf = r->buf + r->offset, .len = (int32_t)(end - r->offset), .suffix = suffix};
+    r->offset = end;
     blok_reader_skip_whitespace(r);
     int suffix_i = 0;
     while(blok_reader_peek(r) == '[' || blok_reader_peek(r) == '*') {
         char ch = blok_reader_getc(r);
         if(suffix_i + 1 > BLOK_SYMBOL_MAX_SUFFIX_COUNT) {
-          blok_fatal_error(&r->src_info,
+          blok_fatal_error(r->locations, blok_reader_location(r),
                            "Suffix provided for symbol is too long, the "
                            "maximum length of a suffix is %d items",
                            BLOK_SYMBOL_MAX_SUFFIX_COUNT);
         }
         if(ch == '*') {
-            sym.suffix[suffix_i++] = BLOK_SUFFIX_ASTERISK;
-            sym.suffix[suffix_i]= BLOK_SUFFIX_NIL;
+            suffix[suffix_i++] = BLOK_SUFFIX_ASTERISK;
+            suffix[suffix_i]= BLOK_SUFFIX_NIL;
         } else if (ch == '[') {
             blok_reader_skip_whitespace(r);
             char second_ch = blok_reader_getc(r);
             if(second_ch != ']') {
-                blok_fatal_error(&r->src_info, "Expected closing bracket, found %c", second_ch);
+                blok_fatal_error(r->locations, blok_reader_location(r), "Expected closing bracket, found %c", second_ch);
             }
-            sym.suffix[suffix_i++] = BLOK_SUFFIX_BRACKET_PAIR;
-            sym.suffix[suffix_i]= BLOK_SUFFIX_NIL;
+            suffix[suffix_i++] = BLOK_SUFFIX_BRACKET_PAIR;
+            suffix[suffix_i]= BLOK_SUFFIX_NIL;
         }
         blok_reader_skip_whitespace(r);
     }
@@ -187,13 +394,13 @@ blok_Obj blok_reader_parse_symbol(blok_State * s, blok_Arena * a, blok_Reader* r
         kv->key = blok_symboldata_intern(s, sym); 
         kv->value = blok_reader_parse_obj(s, a, r);
         blok_Obj result = blok_obj_from_keyvalue(kv);
-        result.src_info = r->src_info;
+        result.location = blok_reader_location(r);
         blok_profiler_stop("reader_parse_symbol");
         return result;
     } else {
         blok_Symbol result = blok_symboldata_intern(s, sym);
         blok_Obj result_obj = blok_make_symbol(result);
-        result_obj.src_info = r->src_info;
+        result_obj.location = blok_reader_location(r);
         blok_profiler_stop("reader_parse_symbol");
         return result_obj;
     }
@@ -213,12 +420,12 @@ blok_Obj blok_reader_parse_list(blok_State * s, blok_Arena * a, blok_Reader * r)
                 blok_reader_skip_char(r, ',');
             }
             if(sublist_count > BLOK_LIST_MAX_SUBLISTS) {
-                blok_fatal_error(&r->src_info, "List contains too many sublists, the maximum amount of sublists is %d", BLOK_LIST_MAX_SUBLISTS);
+                blok_fatal_error(r->locations, blok_reader_location(r), "List contains too many sublists, the maximum amount of sublists is %d", BLOK_LIST_MAX_SUBLISTS);
             }
             sublists[sublist_count++] = blok_list_allocate(a, 4);
 
             while(blok_reader_peek(r) != ')' && blok_reader_peek(r) != ',' && !blok_reader_eof(r)) {
-                blok_list_append(sublists[sublist_count - 1], a, blok_reader_parse_obj(s, a, r));
+                blok_list_append_move(sublists[sublist_count - 1], a, blok_reader_parse_obj(s, a, r));
                 blok_reader_skip_whitespace(r);
             }
 
@@ -231,12 +438,12 @@ blok_Obj blok_reader_parse_list(blok_State * s, blok_Arena * a, blok_Reader * r)
         } else {
             result = blok_list_allocate(a, sublist_count);
             for(int i = 0; i < sublist_count; ++i) {
-                blok_list_append(result, a, blok_obj_from_list(sublists[i]));
+                blok_list_append_move(result, a, blok_obj_from_list(sublists[i]));
             }
         }
 
         blok_Obj result_obj = blok_obj_from_list(result);
-        result_obj.src_info = r->src_info;
+        result_obj.location = blok_reader_location(r);
         blok_profiler_stop("reader_parse_list");
         return result_obj;
 }
@@ -247,7 +454,7 @@ blok_Obj blok_reader_parse_obj(blok_State * s, blok_Arena * a, blok_Reader * r)
     blok_reader_skip_whitespace(r);
     const char ch = blok_reader_peek(r);
 
-    if(isdigit(ch)) {
+    if(blok_reader_char_is(ch, BLOK_CHAR_DIGIT)) {
         blok_profiler_stop("reader_parse_obj");
         return blok_reader_parse_int(r); 
     } else if(ch == '(') {
@@ -260,37 +467,356 @@ blok_Obj blok_reader_parse_obj(blok_State * s, blok_Arena * a, blok_Reader * r)
         blok_profiler_stop("reader_parse_obj");
         return blok_reader_parse_symbol(s, a, r);
     } else {
-        blok_fatal_error(&r->src_info, "Encountered unexpected character '%c' when parsing object", ch);
+        blok_fatal_error(r->locations, blok_reader_location(r), "Encountered unexpected character '%c' when parsing object", ch);
     }
     /*return blok_make_nil();*/
 }
 
-blok_Obj blok_reader_read_file(blok_State * s, blok_Arena * a, char const * path) {
+/*records the lines that begin in buf[from, len), the parser never has to look for newlines*/
+void blok_reader_index_lines(blok_Reader * r, uint32_t from) {
+    if(r->buf == NULL) return;
+    const char * end = r->buf + r->len;
+    for(const char * it = r->buf + from; it < end; ++it) {
+        it = memchr(it, '\n', end - it);
+        if(it == NULL) break;
+        blok_location_add_line(r->locations, r->file, r->base + (uint32_t)(it - r->buf) + 1);
+    }
+}
 
-    blok_profiler_start("reader_read_file");
-    blok_List * result = blok_list_allocate(a, 32);
+/*reads `buf` in place, it has to outlive the reader and every object read from it
+ * since strings borrow from it*/
+blok_Reader blok_reader_from_buffer(blok_LocationTable * locations, char const * name, const char * buf, size_t len) {
+    if(len > UINT32_MAX) {
+        blok_fatal_error(NULL, BLOK_LOCATION_NONE, "Source is too large: %s\n", name);
+    }
+    blok_Reader r = {.buf = buf, .len = (uint32_t)len, .fd = -1, .borrow = true, .locations = locations};
+    r.file = blok_location_add_file(locations, name);
+    blok_reader_index_lines(&r, 0);
+    blok_reader_skip_whitespace(&r);
+    return r;
+}
+
+/*appends whatever the stream has ready to the buffer, false once it is exhausted*/
+bool blok_reader_refill(blok_Reader * r) {
+    assert(r->fd >= 0);
+    if(r->len == r->cap) {
+        const uint32_t cap = r->cap == 0 ? BLOK_READER_CHUNK_SIZE : r->cap * 2;
+        if(cap <= r->cap) {
+            blok_fatal_error(r->locations, BLOK_LOCATION_NONE, "Toplevel form is too large");
+        }
+        char * grown = blok_allocator_realloc(r->allocator, (char *)r->buf, cap);
+        if(grown == NULL) {
+            blok_fatal_error(r->locations, BLOK_LOCATION_NONE, "Out of memory while reading source");
+        }
+        r->buf = grown;
+        r->cap = cap;
+    }
+    ssize_t count;
+    do {
+        count = read(r->fd, (char *)r->buf + r->len, r->cap - r->len);
+    } while(count < 0 && errno == EINTR);
+    if(count < 0) {
+        blok_fatal_error(r->locations, BLOK_LOCATION_NONE, "Failed to read source: %s", strerror(errno));
+    }
+    if(count == 0) {
+        close(r->fd);
+        r->fd = -1;
+        return false;
+    }
+    if((uint64_t)r->base + r->len + count > UINT32_MAX) {
+        blok_fatal_error(r->locations, BLOK_LOCATION_NONE, "Source is too large");
+    }
+    const uint32_t from = r->len;
+    r->len += (uint32_t)count;
+    blok_reader_index_lines(r, from);
+    return true;
+}
+
+bool blok_reader_is_form_delimiter(char ch) {
+    return blok_reader_is_whitespace(ch) || ch == '(' || ch == ')' || ch == '"' || ch == ':'
+        || ch == '[' || ch == ']' || ch == '*' || ch == ',';
+}
+
+/*starts the pre-scan over at the cursor*/
+void blok_reader_restart_scan(blok_Reader * r) {
+    r->scan = (blok_ReaderScan){.offset = r->offset};
+}
+
+/* True once the next toplevel form and the character after it are buffered,
+ * the parser looks one character past a form for suffixes and keyvalues.
+ * Only brackets, strings and tokens are tracked, the parser reports errors.
+ * Picks up where the previous call stopped, so every byte is scanned once*/
+bool blok_reader_form_buffered(blok_Reader * r) {
+    const char * buf = r->buf;
+    const uint32_t len = r->len;
+    blok_ReaderScan * sc = &r->scan;
+    uint32_t i = sc->offset;
+    bool complete = false;
+    while(i < len && !complete) {
+        const char ch = buf[i];
+        if(sc->string) {
+            if(ch == '"') {
+                sc->string = false;
+                sc->item = sc->depth == 0;
+            }
+            i += ch == '\\' ? 2 : 1;
+        } else if(sc->token) {
+            if(blok_reader_is_form_delimiter(ch)) {
+                sc->token = false;
+            } else {
+                ++i;
+            }
+        } else if(blok_reader_is_whitespace(ch)) {
+            ++i;
+        } else if(sc->depth == 0 && sc->item) {
+            /*suffixes and keyvalues continue the symbol in front of them*/
+            if(ch == ':' || ch == '[') {
+                sc->item = false;
+            } else if(ch != ']' && ch != '*') {
+                complete = true;
+                break;
+            }
+            ++i;
+        } else if(ch == '"') {
+            sc->string = true;
+            ++i;
+        } else if(ch == '(') {
+            ++sc->depth;
+            ++i;
+        } else if(ch == ')') {
+            if(sc->depth == 0) {
+                complete = true;
+                break;
+            }
+            --sc->depth;
+            ++i;
+            sc->item = sc->depth == 0;
+        } else if(sc->depth == 0) {
+            sc->token = true;
+            sc->item = true;
+            ++i;
+        } else {
+            ++i;
+        }
+    }
+    sc->offset = i;
+    return complete;
+}
+
+/*drops the forms that were already read, then reads until the next one is complete*/
+void blok_reader_fill_form(blok_Reader * r) {
+    if(r->fd < 0) return;
+    blok_profiler_do("reader_fill_form") {
+        if(r->offset > 0) {
+            memmove((char *)r->buf, r->buf + r->offset, r->len - r->offset);
+            r->base += r->offset;
+            r->len -= r->offset;
+            r->offset = 0;
+        }
+        blok_reader_restart_scan(r);
+        while(!blok_reader_form_buffered(r) && blok_reader_refill(r));
+    }
+}
+
+/*reads a stream like a pipe, the reader takes over `fd` and buffers it with `allocator`*/
+blok_Reader blok_reader_from_stream(blok_LocationTable * locations, blok_Allocator allocator, char const * name, int fd) {
+    blok_Reader r = blok_reader_from_buffer(locations, name, NULL, 0);
+    r.allocator = allocator;
+    r.fd = fd;
+    r.owned = true;
+    r.borrow = false;
+    return r;
+}
+
+blok_Reader blok_reader_open(blok_LocationTable * locations, blok_Allocator allocator, char const * path) {
+    blok_profiler_start("reader_open");
+    /*"-" reads stdin*/
+    const int fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if(fd < 0) {
+        blok_fatal_error(NULL, BLOK_LOCATION_NONE, "Failed to open file: %s\n", path);
+    }
+    struct stat st;
+    const bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    void * map = MAP_FAILED;
+    if(regular && st.st_size > 0 && (uint64_t)st.st_size <= UINT32_MAX) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
 
     blok_Reader r = {0};
-    r.fp = fopen(path, "r");
+    if(map != MAP_FAILED) {
+        close(fd);
+        r = blok_reader_from_buffer(locations, path, map, st.st_size);
+        r.mapped = true;
+        r.owned = true;
+        r.borrow = false; /*the buffer goes away with the reader*/
+    } else {
+        /*pipes and the like are streamed, the buffer only holds the form being read*/
+        r = blok_reader_from_stream(locations, allocator, path, fd);
+    }
+    blok_profiler_stop("reader_open");
+    return r;
+}
 
-    //size_t len = strlen(path);
-    //char * path_copy = blok_arena_alloc(a, len + 1);
-    //strncpy(path_copy, path, len);
-    strncpy(r.src_info.file, path, sizeof(r.src_info.file) - 1 );
-    r.src_info.line = 1;
+void blok_reader_close(blok_Reader * r) {
+    if(r->fd >= 0) {
+        close(r->fd);
+    }
+    if(r->owned && r->mapped) {
+        munmap((void *)r->buf, r->len);
+    } else if(r->owned) {
+        blok_allocator_free(r->allocator, (void *)r->buf);
+    }
+    *r = (blok_Reader){.fd = -1};
+}
 
-    if(r.fp == NULL) {
-        blok_fatal_error(NULL, "Failed to open file: %s\n", path);
+/*true once there are no toplevel forms left to read*/
+bool blok_reader_done(blok_Reader * r) {
+    return blok_reader_eof(r) || blok_reader_peek(r) == ')';
+}
+
+blok_Obj blok_reader_read_toplevel_form(blok_State * s, blok_Arena * a, blok_Reader * r) {
+    assert(!blok_reader_done(r));
+    blok_Obj result = blok_reader_parse_obj(s, a, r);
+    blok_reader_skip_whitespace(r);
+    return result;
+}
+
+/* Parses the next toplevel form into `form`, false once there are none left.
+ * Strings borrowed from a streamed reader are only valid until the next call*/
+bool blok_reader_next_form(blok_State * s, blok_Arena * a, blok_Reader * r, blok_Obj * form) {
+    blok_reader_fill_form(r);
+    blok_reader_skip_whitespace(r);
+    if(blok_reader_done(r)) return false;
+    *form = blok_reader_read_toplevel_form(s, a, r);
+    return true;
+}
+
+/*reads every toplevel form of the reader into one list*/
+blok_Obj blok_reader_read_all_forms(blok_State * s, blok_Arena * a, blok_Reader * r) {
+    blok_List * result = blok_list_allocate(a, 32);
+    blok_Obj form;
+    while(blok_reader_next_form(s, a, r, &form)) {
+        blok_list_append_move(result, a, form);
     }
-    //blok_list_append(result, blok_make_symbol(a, "toplevel"));
-    blok_reader_skip_whitespace(&r);
-    while(!blok_reader_eof(&r) && blok_reader_peek(&r) != ')') {
-        blok_list_append(result, &s->persistent_arena, blok_reader_parse_obj(s, a, &r));
+    return blok_obj_from_list(result);
+}
+
+blok_Obj blok_reader_read_file(blok_State * s, blok_Arena * a, char const * path) {
+    blok_profiler_start("reader_read_file");
+    blok_Reader r = blok_reader_open(&s->locations, s->persistent_arena.allocator, path);
+    blok_Obj result = blok_reader_read_all_forms(s, a, &r);
+    blok_reader_close(&r);
+    blok_profiler_stop("reader_read_file");
+    return result;
+}
+
+/*reads source that is already in memory, `name` is only used for locations*/
+blok_Obj blok_reader_read_buffer(blok_State * s, blok_Arena * a, char const * name, const char * buf, size_t len) {
+    blok_profiler_start("reader_read_buffer");
+    blok_Reader r = blok_reader_from_buffer(&s->locations, name, buf, len);
+    blok_Obj result = blok_reader_read_all_forms(s, a, &r);
+    blok_reader_close(&r);
+    blok_profiler_stop("reader_read_buffer");
+    return result;
+}
+
+void blok_reader_run_tests(blok_State * s) {
+    blok_profiler_do("reader_run_tests") {
+        assert(blok_reader_parse_8_digits("12345678") == 12345678);
+        assert(blok_reader_parse_8_digits("00000009") == 9);
+
+        /*long enough that the vector loops run before the scalar tail*/
+        const char * text = "      \t\n                          symbol_name_that_is_long_enough#<=>|&9 \"a string without escapes that goes on\\n\"";
+        const uint32_t len = (uint32_t)strlen(text);
+        const uint32_t symbol = blok_reader_scan_whitespace(text, 0, len);
+        assert(text[symbol] == 's');
+        const uint32_t space = blok_reader_scan_symbol(text, symbol, len);
+        assert(text[space] == ' ' && text[space - 1] == '9');
+        const uint32_t escape = blok_reader_scan_string(text, space + 2, len);
+        assert(text[escape] == '\\');
+        assert(blok_reader_scan_string(text, escape + 2, len) == len - 1);
+        assert(blok_reader_scan_whitespace(text, len, len) == len);
+
+        blok_Reader r = blok_reader_from_buffer(&s->locations, "reader_test", "0002147483647 12", 16);
+        const blok_Obj max = blok_reader_parse_int(&r);
+        assert(max.as.data == INT32_MAX);
+        blok_reader_skip_whitespace(&r);
+        const blok_Obj twelve = blok_reader_parse_int(&r);
+        assert(twelve.as.data == 12);
+        (void)max;
+        (void)twelve;
+        assert(blok_reader_eof(&r));
+        blok_reader_close(&r);
+
+        /*plain strings borrow from the source, escaped ones are materialized*/
+        blok_Arena a = {0};
+        const char * source = "\"plain\" \"esc\\n\"";
+        r = blok_reader_from_buffer(&s->locations, "reader_test", source, strlen(source));
+        const blok_String * plain = blok_string_from_obj(blok_reader_parse_string(&a, &r));
+        assert(plain->items.ptr == source + 1 && plain->items.len == 5);
         blok_reader_skip_whitespace(&r);
+        const blok_String * escaped = blok_string_from_obj(blok_reader_parse_string(&a, &r));
+        assert(escaped->items.len == 4 && strcmp(escaped->items.ptr, "esc\n") == 0);
+        blok_reader_close(&r);
+
+        /*a stream only parses a form once it and the character after it arrived*/
+        blok_Reader partial = {.buf = "(1 (2) \"a)\" ) 3 x: (4", .fd = -1};
+        bool buffered;
+        for(partial.len = 0; partial.len <= 21; ++partial.len) {
+            buffered = blok_reader_form_buffered(&partial);
+            assert(buffered == (partial.len >= 15));
+        }
+        partial.offset = 13;
+        partial.len = 16;
+        blok_reader_restart_scan(&partial);
+        buffered = blok_reader_form_buffered(&partial);
+        assert(!buffered);
+        partial.len = 17;
+        buffered = blok_reader_form_buffered(&partial);
+        assert(buffered);
+        partial.offset = 15;
+        partial.len = 21;
+        blok_reader_restart_scan(&partial);
+        buffered = blok_reader_form_buffered(&partial);
+        assert(!buffered);
+
+        /*an escape split across refills is resumed past it*/
+        blok_Reader split = {.buf = "\"a\\\"b\" c", .fd = -1, .len = 3};
+        buffered = blok_reader_form_buffered(&split);
+        assert(!buffered && split.scan.offset == 4);
+        split.len = 8;
+        buffered = blok_reader_form_buffered(&split);
+        assert(buffered);
+        (void)buffered;
+
+        int fds[2];
+        const char * streamed = "(1 (2))\n\"str\" 345 ((6) seven)";
+        if(pipe(fds) == 0) {
+            const ssize_t written = write(fds[1], streamed, strlen(streamed));
+            assert(written == (ssize_t)strlen(streamed));
+            close(fds[1]);
+            (void)written;
+            r = blok_reader_from_stream(&s->locations, s->persistent_arena.allocator, "reader_test", fds[0]);
+            blok_Obj form;
+            int32_t forms = 0;
+            while(blok_reader_next_form(s, &a, &r, &form)) ++forms;
+            assert(forms == 4 && form.tag == BLOK_TAG_LIST);
+            const blok_Obj seven = blok_list_from_obj(form)->items.ptr[1];
+            assert(seven.tag == BLOK_TAG_SYMBOL && strcmp(blok_symbol_get_data(s, seven.as.symbol.id).buf, "seven") == 0);
+            (void)seven;
+            assert(blok_location_get(&s->locations, form.location).line == 2);
+            blok_reader_close(&r);
+            (void)forms;
+        }
+
+        blok_arena_free(&a);
+        (void)plain;
+        (void)escaped;
+        (void)symbol;
+        (void)space;
+        (void)escape;
+        (void)len;
     }
-    fclose(r.fp);
-    blok_profiler_stop("reader_read_file");
-    return blok_obj_from_list(result);
 }
 
 #endif /*BLOK_READER_C*/
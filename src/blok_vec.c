@@ -3,6 +3,7 @@
 
 #include "blok_arena.c"
 #include <stdint.h>
+#include <string.h>
 
 #define blok_Slice(Type)         \
     struct {                     \
@@ -46,17 +47,88 @@ void blok_slice_run_tests(void) {
     }
 
 
+/* A vec with a negative cap keeps its items in storage it does not own, like
+ * the inline buffer of a blok_SmallVec. That storage is never reallocated or
+ * reclaimed, the items are copied into the arena once they outgrow it*/
+#define blok_vec_capacity(vec_ptr) ((vec_ptr)->cap < 0 ? -(vec_ptr)->cap : (vec_ptr)->cap)
+
+#define blok_SmallVec(Type, inline_capacity) \
+    struct {                                 \
+        blok_Slice(Type) items;              \
+        int32_t cap;                         \
+        Type _item;                          \
+        Type inline_items[inline_capacity];  \
+    }
+
+#define blok_small_vec_init(vec_ptr) do { \
+    (vec_ptr)->items.ptr = (vec_ptr)->inline_items; \
+    (vec_ptr)->items.len = 0; \
+    (vec_ptr)->cap = -(int32_t)(sizeof((vec_ptr)->inline_items) / sizeof((vec_ptr)->_item)); \
+} while (0)
+
+/*grows `ptr` so it holds at least `needed` items, the out of line slow path of blok_vec_reserve*/
+void * blok_vec_grow(blok_Arena * a, void * ptr, int32_t * cap, int32_t len, int32_t needed, size_t item_size) {
+    blok_profiler_start("blok_vec_grow");
+    int32_t new_cap = *cap == 0 ? 2 : (*cap < 0 ? -*cap : *cap) * 2 + 1;
+    if(new_cap < needed) new_cap = needed;
+    if(*cap == 0) {
+        assert(ptr == NULL);
+        ptr = blok_arena_alloc(a, new_cap * item_size);
+    } else if(*cap < 0) {
+        void * borrowed = ptr;
+        ptr = blok_arena_alloc(a, new_cap * item_size);
+        memcpy(ptr, borrowed, len * item_size);
+    } else {
+        ptr = blok_arena_realloc(a, ptr, new_cap * item_size);
+    }
+    *cap = new_cap;
+    blok_profiler_stop("blok_vec_grow");
+    return ptr;
+}
+
+/*makes room for `count` more items without further allocations*/
+#define blok_vec_reserve(vec_ptr, arena_ptr, count) do { \
+    if((vec_ptr)->items.len + (count) > blok_vec_capacity(vec_ptr)) { \
+        (vec_ptr)->items.ptr = blok_vec_grow(arena_ptr, (vec_ptr)->items.ptr, &(vec_ptr)->cap, (vec_ptr)->items.len, (vec_ptr)->items.len + (count), sizeof((vec_ptr)->_item)); \
+    } \
+} while (0)
+
 #define blok_vec_append(vec_ptr, arena_ptr, item) do { \
-    blok_profiler_do("blok_vec_append") { \
-        if((vec_ptr)->cap <= 0) { \
-            assert((vec_ptr)->items.ptr == NULL); \
-            (vec_ptr)->cap = 2;    \
-            (vec_ptr)->items.ptr = blok_arena_alloc(arena_ptr, (vec_ptr)->cap * sizeof((vec_ptr)->_item)); \
-        } else if((vec_ptr)->items.len + 1 > (vec_ptr)->cap) { \
-            (vec_ptr)->cap = (vec_ptr)->cap * 2 + 1; \
-            (vec_ptr)->items.ptr = blok_arena_realloc(arena_ptr, (vec_ptr)->items.ptr, (vec_ptr)->cap * sizeof(vec_ptr)->_item); \
+    blok_vec_reserve(vec_ptr, arena_ptr, 1); \
+    (vec_ptr)->items.ptr[(vec_ptr)->items.len++] = item; \
+} while (0)
+
+/*appends `count` items with a single memcpy, only for types that can be copied bytewise*/
+#define blok_vec_append_slice(vec_ptr, arena_ptr, src_ptr, count) do { \
+    (void)((vec_ptr)->items.ptr == (src_ptr)); /*type check*/ \
+    if((count) > 0) { \
+        blok_vec_reserve(vec_ptr, arena_ptr, count); \
+        memcpy(blok_vec_end(vec_ptr), (src_ptr), (count) * sizeof((vec_ptr)->_item)); \
+        (vec_ptr)->items.len += (count); \
+    } \
+} while (0)
+
+/*sets the length to `new_len`, new items are zeroed*/
+#define blok_vec_resize(vec_ptr, arena_ptr, new_len) do { \
+    const int32_t blok_vec_resize_len = (new_len); \
+    assert(blok_vec_resize_len >= 0); \
+    if(blok_vec_resize_len > (vec_ptr)->items.len) { \
+        blok_vec_reserve(vec_ptr, arena_ptr, blok_vec_resize_len - (vec_ptr)->items.len); \
+        memset(blok_vec_end(vec_ptr), 0, (blok_vec_resize_len - (vec_ptr)->items.len) * sizeof((vec_ptr)->_item)); \
+    } \
+    (vec_ptr)->items.len = blok_vec_resize_len; \
+} while (0)
+
+/*gives unused capacity back to the arena*/
+#define blok_vec_shrink_to_fit(vec_ptr, arena_ptr) do { \
+    if((vec_ptr)->cap > (vec_ptr)->items.len) { \
+        if((vec_ptr)->items.len == 0) { \
+            blok_arena_reclaim(arena_ptr, (vec_ptr)->items.ptr); \
+            (vec_ptr)->items.ptr = NULL; \
+        } else { \
+            (vec_ptr)->items.ptr = blok_arena_realloc(arena_ptr, (vec_ptr)->items.ptr, (vec_ptr)->items.len * sizeof((vec_ptr)->_item)); \
         } \
-        (vec_ptr)->items.ptr[(vec_ptr)->items.len++] = item; \
+        (vec_ptr)->cap = (vec_ptr)->items.len; \
     } \
 } while (0)
 
@@ -110,6 +182,27 @@ void blok_vec_run_tests(void) {
         blok_vec_find(it, &v, *it == -1);
         assert(it == NULL);
 
+        blok_Vec(int) bulk = {0};
+        blok_vec_append_slice(&bulk, &a, v.items.ptr, v.items.len);
+        assert(bulk.items.len == v.items.len && bulk.items.ptr[103] == 99);
+        blok_vec_resize(&bulk, &a, 200);
+        assert(bulk.items.ptr[150] == 0);
+        blok_vec_resize(&bulk, &a, 10);
+        blok_vec_shrink_to_fit(&bulk, &a);
+        assert(bulk.cap == 10 && bulk.items.ptr[9] == 5);
+        blok_vec_reserve(&bulk, &a, 90);
+        assert(bulk.cap >= 100 && bulk.items.len == 10);
+
+        blok_SmallVec(int, 4) small;
+        blok_small_vec_init(&small);
+        for(int i = 0; i < 4; ++i) {
+            blok_vec_append(&small, &a, i);
+        }
+        assert(small.items.ptr == small.inline_items);
+        blok_vec_append_slice(&small, &a, bulk.items.ptr, bulk.items.len);
+        assert(small.items.ptr != small.inline_items);
+        assert(small.items.len == 14 && small.items.ptr[3] == 3 && small.items.ptr[13] == 5);
+
         blok_arena_free(&a);
     }
 }
@@ -7,21 +7,43 @@ void close_output(void * out) {
     fclose(out);
 }
 
-int main(void) {
+int main(int argc, char ** argv) {
     blok_profiler_init("profile.json");
 
+    blok_allocator_run_tests();
     blok_arena_run_tests();
     blok_slice_run_tests();
     blok_vec_run_tests();
+    blok_location_run_tests();
+    blok_scopes_run_tests();
+    blok_obj_copy_run_tests();
+    {
+        blok_State test_state = blok_state_init();
+        blok_reader_run_tests(&test_state);
+        blok_state_deinit(&test_state);
+    }
 
+#ifdef BLOK_LEAK_CHECK
+    blok_LeakCheck leak_check = {.child = blok_libc_allocator()};
+    blok_State s = blok_state_init_with_allocator(blok_leak_check_allocator(&leak_check));
+#else
     blok_State s = blok_state_init();
-    blok_Obj source = blok_reader_read_file(&s, &s.persistent_arena, "ideal.blok");
+#endif
 
     s.out = fopen("a.out.c", "w");
     blok_on_exit(close_output, s.out);
-    blok_compiler_toplevel(&s, blok_list_from_obj(source));
+    blok_compiler_compile_file(&s, argc > 1 ? argv[1] : "ideal.blok");
+
+#ifdef BLOK_ARENA_STATS
+    blok_arena_fprint_stats(&s.persistent_arena, stderr);
+#endif
 
     blok_state_deinit(&s);
+#ifdef BLOK_LEAK_CHECK
+    blok_leak_check_fprint_leaks(&leak_check, stderr);
+    assert(blok_leak_check_count_leaks(&leak_check) == 0);
+    blok_leak_check_deinit(&leak_check);
+#endif
     blok_profiler_deinit();
     blok_exit(0);
 }